@@ -75,6 +75,28 @@
   R1 is the top resistor, R2 is the lower resistor.
   "I???E"
   This sets the current gain value, in mV/A
+  "Y???E"
+  This sets the number of records written between each sync of the SD card file.
+  "YE"
+  This forces a sync of the SD card file and prints the write and sync counts.
+  "LE"
+  This prints the SD write latency histogram and I/O counters. "L0E" clears them.
+  "F0E", "F1E" or "F2????E"
+  This starts a new data file every day, every hour, or every day and whenever the file reaches ???? KB.
+  "CE"
+  This prints the SD card free space (KB), the days left at the current rate and the space policy.
+  "C0E" never deletes files. "C1????E" deletes the oldest days of files when less than ???? MB is free.
+  "PE"
+  This prints the SPI clock divisor used for the SD card (2 = full, 4 = half, 8 = quarter speed).
+  "P0E" finds the fastest clock that works again.
+  "ME" or "M???E"
+  This prints or sets the fields recorded, as the sum of 1 wind speed, 2 direction, 4 temperature, 8 irradiance,
+  16 external volts and 32 external amps (the battery voltage is always recorded). "M255E" goes back to the default (11).
+  The new fields start in a new file (the next part of the day, DYYMMDD1 etc).
+  "KE" or "K???E"
+  This prints or sets the anemometer pulse lockout time, in ms (0 to 250, 0 counts every pulse, default 2).
+  A pulse less than ??? ms after the last one counted is rejected as switch bounce or noise.
+  "KE" also prints an estimate of how long the check takes in each pulse interrupt, in ns.
  
   
   // Addedd Interrupt code from here:
@@ -109,7 +131,6 @@
   Sort out Voltage conversion (via serial) - implemented - TEST
   Sort out Current conversion (via serial) - implemented - TEST
   Sort out RPM sensor (want RPM value, so convert correctly)
-  Sort out maximum wind speed in time period
  
  //*********SD CARD DETAILS***************************	
  The SD card circuit:
@@ -146,13 +167,14 @@
 #include "temperature.h"
 #include "rtc.h"
 #include "sd.h"
+#include "binary_record.h"
 
 /********* I/O Pins *************/
 #define RED_LED_PIN 4      // The output led is on pin 4
 #define CALIBRATE_PIN 6   // This controls if we are in serial calibrate mode or not
 
 #define FLASH_PERIOD (10)
-static int s_aliveFlashCounter = 0;  // This is used to count to give flash every 10 seconds
+static volatile uint8_t s_aliveFlashCounter = 0;  // This is used to count to give flash every 10 seconds
 static bool s_debugFlag = false;    // Set this if you want to be in debugging mode.
 static bool s_error = false;
 static bool s_calibrate_mode = false;
@@ -252,7 +274,8 @@ static void handleCalibration()
  *
  *  Parameters:  None.
  *
- *  Description: Read the SD card present and calibrate inputs.           
+ *  Description: Read the SD card state and calibrate input.
+ *               The card detect pin itself is debounced by the SD module.
  *
  ***************************************************/
 void readInputs()
@@ -291,8 +314,6 @@ void setup()
   // Initialise the real time clock (A4 = scl, A5 = sda, 2 = 1Hz clock input)
   RTC_Setup(A4, A5, 2);  
   
-  SD_CreateFileForToday();  // Create the corrct filename (from date)
-
   // Read the reference number from the EEPROM
   char deviceID[2];
   EEPROM_GetDeviceID(deviceID);
@@ -300,7 +321,7 @@ void setup()
   
   // Read in the sample time from EEPROM
   SD_SetSampleTime( EEPROM_GetSampleTime() );
-  
+
   // Read the Current Voltage Offset from the EEROM
   VA_SetCurrentOffset( EEPROM_GetCurrentOffset() );
 
@@ -313,6 +334,17 @@ void setup()
   VA_SetCurrentGain( EEPROM_GetCurrentGain() );
   
   WIND_SetWindvanePosition( EEPROM_GetWindwavePosition() );
+
+  WIND_SetDebounce( EEPROM_GetDebounceMs() );
+
+  SD_SetSyncRecords( EEPROM_GetSyncRecords() );
+
+  // Choose the fields to record
+  SD_SetFieldMask( EEPROM_GetFieldMask() );
+
+  // Initialise the card and create the correct filename (from date)
+  // This is done after all the calibration values are set, as any stored records are written out first
+  SD_ServiceCard();
   
   // Interrupt for the 1Hz signal from the RTC
   RTC_EnableInterrupt();
@@ -339,7 +371,19 @@ void loop()
   // *********** WIND DIRECTION **************************************  
   // Want to measure the wind direction every second to give good direction analysis
   // This can be checked every second and an average used
-  WIND_ConvertWindDirection(analogRead(VANE_PIN));    // Run this every second. It increments the windDirectionArray 
+  // The same reading goes into the raw stream (if SD_RAW_STREAM is 1)
+  // The vane is not read at all if the direction is not being recorded
+  if (SD_FieldIsRecorded(BINARY_FIELD_WIND_DIRECTION))
+  {
+    SD_WriteRawSecond(WIND_ConvertWindDirection(analogRead(VANE_PIN)));    // Run this every second. It increments the windDirectionArray 
+  }
+  else
+  {
+    SD_WriteRawSecond(WIND_NO_DIRECTION);
+  }
+
+  // Add the pulses counted in each second since the last loop to the wind statistics
+  WIND_UpdateStatistics();
   
   flashLED();
 
@@ -351,6 +395,9 @@ void loop()
     ledOff();
     Serial.flush();    // Force out the end of the serial data
   }
+
+  // A newly inserted card is initialised after the sample has been written
+  SD_ServiceCard();
    
   WIND_Debug();
   
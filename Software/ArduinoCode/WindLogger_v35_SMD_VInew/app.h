@@ -5,24 +5,104 @@
  * Defines and typedefs
  */
 
-// If READ_WINDSPEED is 1, the windspeed will be read and included in serial data
+// The READ_ switches choose which field modules are compiled in. The fields that are actually read and recorded
+// are chosen at runtime from these by the field mask ("M???E" serial command, stored in EEPROM). The mask cannot
+// add a field that is not compiled in, so set a switch to 1 for every field any site using this build may need.
+
+// If READ_WINDSPEED is 1, the windspeed can be read and included in serial data
 #define READ_WINDSPEED 1
 
-// If READ_WIND_DIRECTION is 1, the windspeed will be read and included in serial data
+// If READ_WIND_STATISTICS is 1 (and READ_WINDSPEED is 1), the pulses from each anemometer are also counted every second,
+// and the highest 1 second count (Peak), highest 3 second mean (Gust), standard deviation (SD) and turbulence intensity (TI)
+// of the per-second counts in each period are recorded with the wind speed. CSV files only (not SD_BINARY_FORMAT).
+#define READ_WIND_STATISTICS 0
+
+// If READ_WIND_PERIODS is 1 (and READ_WINDSPEED is 1), each anemometer pulse is timestamped from Timer1, and the mean
+// pulse frequency (Freq, pulses per second to 3 decimal places) and the mean and shortest times between pulses
+// (Mean ms, Min ms) in each period are recorded with the wind speed. This resolves low wind speeds that only give a
+// few pulses per period. Timer1 does not run in power-down sleep, so the logger uses idle sleep instead, which takes
+// more current (see sleep.cpp). CSV files only (not SD_BINARY_FORMAT).
+#define READ_WIND_PERIODS 0
+
+// If WIND_DEBOUNCE is 1, an anemometer pulse that comes less than the lockout time ("K???E", stored in EEPROM)
+// after the last pulse counted is rejected as switch bounce or noise. The rejected pulses in each period are
+// recorded in the Rejected columns. CSV files only (not SD_BINARY_FORMAT).
+#define WIND_DEBOUNCE 0
+
+// If READ_WIND_DIRECTION is 1, the wind direction can be read and included in serial data
 #define READ_WIND_DIRECTION 1
 
-// If READ_TEMPERATURE is 1, the temperature will be read and included in serial data
+// If WIND_VECTOR_DIRECTION is 1 (and READ_WIND_DIRECTION is 1), each wind vane reading is also added up as a unit vector,
+// and the vector mean direction (Mean dir) and Yamartino standard deviation (Sigma) of the readings in each period are
+// recorded with the direction, in degrees. Unlike the most frequent direction, the mean is correct either side of North.
+// CSV files only (not SD_BINARY_FORMAT).
+#define WIND_VECTOR_DIRECTION 0
+
+// If WIND_WEIGHTED_DIRECTION is 1 (and WIND_VECTOR_DIRECTION and READ_WINDSPEED are 1), a mean direction with each
+// vane reading weighted by the anemometer 1 pulses since the last reading (Weighted dir) is also recorded.
+#define WIND_WEIGHTED_DIRECTION 0
+
+// If READ_TEMPERATURE is 1, the temperature can be read and included in serial data
 #define READ_TEMPERATURE 0
 
-// If READ_IRRADIANCE is 1, the irradiance will be read and included in serial data
+// If READ_IRRADIANCE is 1, the irradiance can be read and included in serial data
 #define READ_IRRADIANCE 1
 
-// If READ_EXTERNAL_VOLTS is 1, the external voltage will be read and included in serial data
+// If READ_EXTERNAL_VOLTS is 1, the external voltage can be read and included in serial data
 #define READ_EXTERNAL_VOLTS 0
 
-// If READ_EXTERNAL_AMPS is 1, the external current will be read and included in serial data
+// If READ_EXTERNAL_AMPS is 1, the external current can be read and included in serial data
 #define READ_EXTERNAL_AMPS 0
 
+// If SD_BINARY_FORMAT is 1, records are written as fixed-size binary records to DYYMMDD.bin files (see binary_record.h)
+// instead of CSV lines. Use the wlconvert tool (Software/HostTools/wlconvert) to convert the files to CSV.
+#define SD_BINARY_FORMAT 0
+
+// If SD_DELTA_ENCODING is 1 (requires SD_BINARY_FORMAT), most records are stored as small varint deltas against
+// the previous record, with a full record (keyframe) at the start of every sector. Files are named DYYMMDD.bin.
+#define SD_DELTA_ENCODING 0
+
+// If SD_STORE_AND_FORWARD is 1, records taken while the SD card is absent are kept in RAM and then spare EEPROM,
+// and written to the correct day's files (with a Backfilled column/marker set) when the card is back.
+#define SD_STORE_AND_FORWARD 0
+
+// If SD_RECORD_CHECKS is 1, every record ends with a sequence number and a CRC-16 (Seq and CRC columns in CSV files).
+// When the day's file is reopened, a record torn by a power failure at the end of the file is removed.
+// Use the wlvalidate tool (Software/HostTools/wlvalidate) to check CSV files.
+#define SD_RECORD_CHECKS 0
+
+// If SD_RAW_STREAM is 1, the pulses counted by each anemometer and the wind vane direction for every second are also
+// written to a compact binary .raw file next to each data file (see binary_record.h). The data file keeps the S?????E
+// sample period. Seconds are written to the card 32 at a time. Use wlconvert to convert .raw files to CSV.
+#define SD_RAW_STREAM 0
+
+// If SD_DAILY_SUMMARY is 1, running totals for each day are kept as records are taken, and one row per day
+// (records, mean and maximum wind pulse counts, dominant direction, min/max battery V) is added to SUMMARY.csv
+// after the first record of the next day.
+#define SD_DAILY_SUMMARY 0
+
+// If SD_KEEP_FILE_OPEN is 1, the daily data file is opened once and records are appended through the SdFat cache.
+// The file is synced every SD_DEFAULT_SYNC_RECORDS records (configurable over serial) or SD_MAX_SECONDS_BETWEEN_SYNCS seconds.
+// If SD_KEEP_FILE_OPEN is 0, the file is opened and closed for every record.
+#define SD_KEEP_FILE_OPEN 1
+#define SD_DEFAULT_SYNC_RECORDS 10
+#define SD_MAX_SECONDS_BETWEEN_SYNCS 60 // Maximum 255
+
+// If SD_WRITE_BEHIND is 1, records are queued in a 512-byte RAM buffer and written to the card one whole sector
+// at a time (or when SD_MAX_SECONDS_BETWEEN_SYNCS has passed). Requires SD_KEEP_FILE_OPEN.
+// Note that this uses a quarter of the RAM on an ATMEGA328P.
+#define SD_WRITE_BEHIND 0
+
+// If SD_LOW_LATENCY is 1, each day's file is pre-allocated as one contiguous extent when it is created.
+// Queued sectors are then streamed to it with raw multi-block writes, so there is no FAT or directory traffic
+// during the day. The file is truncated to its real length at rollover. Requires SD_WRITE_BEHIND.
+#define SD_LOW_LATENCY 0
+
+// If SD_POWER_GATING is 1 (requires SD_WRITE_BEHIND), the SD card supply is switched by SD_POWER_PIN (see sd.cpp).
+// The card is only powered up while it is written to (normally once per queued sector) and is powered down again,
+// with the SPI lines floating, before the logger sleeps. The "YE" command prints an estimate of the card energy per record.
+#define SD_POWER_GATING 0
+
 /*
  * Application functions
  */
@@ -0,0 +1,248 @@
+/*
+ * backfill.cpp
+ *
+ * Store-and-forward of records while the SD card is absent for Wind Data logger.
+ *
+ * The newest records are held in a small RAM ring. When that is full, the oldest
+ * record in RAM is moved to a ring in spare EEPROM (which also survives a reset).
+ * If the EEPROM ring fills too, its oldest record is lost.
+ * Records are read back oldest first, from EEPROM and then from RAM.
+ *
+ * Each EEPROM slot has a tag byte: EEPROM_BACKFILL_EMPTY_TAG for a free slot, or a number
+ * that goes up by one (modulo EEPROM_BACKFILL_TAGS) for each record written. The ring's head
+ * and count are found from the tags at setup, so no fixed EEPROM location is rewritten
+ * for every record (which would wear it out within days at short sample times).
+ *
+ * James Fowkes
+ */
+
+#include <Arduino.h>
+
+/*
+ * Application Includes
+ */
+
+#include "app.h"
+#include "eeprom_storage.h"
+#include "backfill.h"
+
+#if SD_STORE_AND_FORWARD == 1
+
+/* 
+ * Private Variables
+ */
+
+static uint8_t s_recordSize = 0; // 0 until set up
+
+static char s_ramRecords[BACKFILL_RAM_BYTES];
+static uint8_t s_ramCapacity = 0;
+static uint8_t s_ramHead = 0;
+static uint8_t s_ramCount = 0;
+
+static uint16_t s_eepromCapacity = 0;
+static uint16_t s_eepromHead = 0;
+static uint16_t s_eepromCount = 0;
+static uint8_t s_nextTag = 0; // Tag for the next record written to EEPROM
+
+static unsigned long s_lostCount = 0;
+
+/* 
+ * Private Functions
+ */
+
+static uint8_t readTag(uint16_t slot)
+{
+	return EEPROM_ReadBackfillTag(slot % s_eepromCapacity, s_recordSize);
+}
+
+static uint8_t nextTag(uint8_t tag)
+{
+	return (tag + 1) % EEPROM_BACKFILL_TAGS;
+}
+
+/*
+ * findEepromRecords
+ * Finds the oldest record in the EEPROM ring (the first tagged slot whose tag doesn't follow
+ * on from the slot before it) and counts the records with consecutive tags from there
+ */
+static void findEepromRecords()
+{
+	s_eepromHead = 0;
+	s_eepromCount = 0;
+	s_nextTag = 0;
+
+	for (uint16_t slot = 0; slot < s_eepromCapacity; slot++)
+	{
+		uint8_t tag = readTag(slot);
+		if (tag == EEPROM_BACKFILL_EMPTY_TAG) { continue; }
+
+		uint8_t previous = readTag(slot + s_eepromCapacity - 1);
+		if ((previous != EEPROM_BACKFILL_EMPTY_TAG) && (nextTag(previous) == tag)) { continue; }
+
+		s_eepromHead = slot;
+		do
+		{
+			s_eepromCount++;
+			s_nextTag = nextTag(tag);
+			tag = readTag(slot + s_eepromCount);
+		} while ((s_eepromCount < s_eepromCapacity) && (tag == s_nextTag));
+		return;
+	}
+}
+
+/*
+ * clearEepromRecords
+ * Frees every slot (only the tags that aren't already free are written)
+ */
+static void clearEepromRecords()
+{
+	for (uint16_t slot = 0; slot < s_eepromCapacity; slot++)
+	{
+		EEPROM_WriteBackfillTag(slot, s_recordSize, EEPROM_BACKFILL_EMPTY_TAG);
+	}
+}
+
+static char * ramRecord(uint8_t slot)
+{
+	return &s_ramRecords[(uint16_t)slot * s_recordSize];
+}
+
+/*
+ * moveOldestToEEPROM
+ * Frees a RAM slot by moving the oldest RAM record to the EEPROM ring
+ */
+static void moveOldestToEEPROM()
+{
+	if (s_eepromCount == s_eepromCapacity)
+	{
+		// EEPROM is full too: lose the oldest record
+		s_eepromHead = (s_eepromHead + 1) % s_eepromCapacity;
+		s_eepromCount--;
+		s_lostCount++;
+	}
+
+	uint16_t slot = (s_eepromHead + s_eepromCount) % s_eepromCapacity;
+
+	// The slot is free while it is rewritten, so a record torn by a reset is never read back
+	EEPROM_WriteBackfillTag(slot, s_recordSize, EEPROM_BACKFILL_EMPTY_TAG);
+	EEPROM_WriteBackfillRecord(slot, ramRecord(s_ramHead), s_recordSize);
+	EEPROM_WriteBackfillTag(slot, s_recordSize, s_nextTag);
+	s_nextTag = nextTag(s_nextTag);
+	s_eepromCount++;
+
+	s_ramHead = (s_ramHead + 1) % s_ramCapacity;
+	s_ramCount--;
+}
+
+/* 
+ * Public Functions
+ */
+
+/* 
+ * BACKFILL_Setup
+ * Sets the size of each record and picks up any records left in EEPROM from before a reset.
+ * Has no effect once set up, so any records held in RAM are kept.
+ * sd.cpp checks at compile time that a record fits in BACKFILL_RAM_BYTES.
+ */
+void BACKFILL_Setup(uint8_t record_size)
+{
+	if ((s_recordSize == record_size) || (record_size == 0) || (record_size > BACKFILL_RAM_BYTES)) { return; }
+
+	s_recordSize = record_size;
+	s_ramCapacity = BACKFILL_RAM_BYTES / record_size;
+	s_ramHead = 0;
+	s_ramCount = 0;
+
+	s_eepromCapacity = EEPROM_GetBackfillCapacity(record_size);
+
+	// Records from a build with different fields can't be used
+	if (EEPROM_GetBackfillRecordSize() != record_size)
+	{
+		clearEepromRecords();
+		EEPROM_SetBackfillRecordSize(record_size);
+	}
+
+	findEepromRecords();
+}
+
+/* 
+ * BACKFILL_Store
+ * Stores a record until the SD card returns
+ */
+void BACKFILL_Store(const char * record)
+{
+	if (!s_recordSize) { return; }
+
+	if (s_ramCount == s_ramCapacity)
+	{
+		moveOldestToEEPROM();
+	}
+
+	memcpy(ramRecord((s_ramHead + s_ramCount) % s_ramCapacity), record, s_recordSize);
+	s_ramCount++;
+}
+
+/* 
+ * BACKFILL_Peek
+ * Copies the oldest stored record into record. Returns false if there are none.
+ */
+bool BACKFILL_Peek(char * record)
+{
+	if (s_eepromCount)
+	{
+		EEPROM_ReadBackfillRecord(s_eepromHead, record, s_recordSize);
+		return true;
+	}
+	
+	if (s_ramCount)
+	{
+		memcpy(record, ramRecord(s_ramHead), s_recordSize);
+		return true;
+	}
+
+	return false;
+}
+
+/* 
+ * BACKFILL_Drop
+ * Removes the oldest stored record (once it has been written to the card)
+ */
+void BACKFILL_Drop(void)
+{
+	if (s_eepromCount)
+	{
+		EEPROM_WriteBackfillTag(s_eepromHead, s_recordSize, EEPROM_BACKFILL_EMPTY_TAG);
+		s_eepromHead = (s_eepromHead + 1) % s_eepromCapacity;
+		s_eepromCount--;
+	}
+	else if (s_ramCount)
+	{
+		s_ramHead = (s_ramHead + 1) % s_ramCapacity;
+		s_ramCount--;
+	}
+}
+
+uint16_t BACKFILL_GetCount(void)
+{
+	return s_eepromCount + s_ramCount;
+}
+
+/* 
+ * BACKFILL_GetLostCount
+ * Returns the number of records lost because the store was full
+ */
+unsigned long BACKFILL_GetLostCount(void)
+{
+	return s_lostCount;
+}
+
+#else
+
+void BACKFILL_Setup(uint8_t record_size) { (void)record_size; }
+void BACKFILL_Store(const char * record) { (void)record; }
+bool BACKFILL_Peek(char * record) { (void)record; return false; }
+void BACKFILL_Drop(void) {}
+uint16_t BACKFILL_GetCount(void) { return 0; }
+unsigned long BACKFILL_GetLostCount(void) { return 0; }
+
+#endif
@@ -0,0 +1,23 @@
+#ifndef _BACKFILL_H_
+#define _BACKFILL_H_
+
+// Defines
+#define BACKFILL_RAM_BYTES 96 // RAM for the newest records before they are moved to EEPROM
+
+#if SD_STORE_AND_FORWARD == 1
+#define BACKFILL_HEADERS ", Backfilled"
+#else
+#define BACKFILL_HEADERS ""
+#endif
+
+// Public Functions
+void BACKFILL_Setup(uint8_t record_size);
+
+void BACKFILL_Store(const char * record);
+bool BACKFILL_Peek(char * record);
+void BACKFILL_Drop(void);
+
+uint16_t BACKFILL_GetCount(void);
+unsigned long BACKFILL_GetLostCount(void);
+
+#endif
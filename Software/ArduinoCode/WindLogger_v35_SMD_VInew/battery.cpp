@@ -10,12 +10,13 @@
 #include <Arduino.h>
 
 #include "utility.h"
+#include "fixed_point.h"
 #include "battery.h"
 
 /* 
  * Private Variables
  */
-static char s_batteryVoltStr[6];      // Hold the battery voltage as a string
+static uint16_t s_batteryReading;      // Hold the battery voltage ADC reading
 
 /* 
  * Public Functions
@@ -30,14 +31,26 @@ void BATT_UpdateBatteryVoltage(void)
 	// *********** BATTERY VOLTAGE ***************************************
     // From Vcc-470k-DATA-100k-GND potential divider
     // This is to test in case battery voltage has dropped too low - alert?
-    float batteryVoltage;
-    batteryVoltage = float(analogRead(BATT_VOLTAGE_PIN))*(3.3f/1024.0f)*((470.0f+100.0f)/100.0f);        // Temporary store for float
-    dtostrf(batteryVoltage, 2, 2, s_batteryVoltStr);     // Hold the battery voltage as a string
+    s_batteryReading = analogRead(BATT_VOLTAGE_PIN);
 }
 
+/* 
+ * BATT_GetReading
+ * Returns the raw ADC reading from the last update
+ */
+uint16_t BATT_GetReading(void)
+{
+	return s_batteryReading;
+}
 
-void BATT_WriteVoltageToBuffer(FixedLengthAccumulator * accum)
+/* 
+ * BATT_WriteVoltageToBuffer
+ * Converts an ADC reading (from BATT_GetReading) to volts and writes it to the accumulator
+ */
+void BATT_WriteVoltageToBuffer(uint16_t reading, FixedLengthAccumulator * accum)
 {
 	if (!accum) { return; }
-	accum->writeString(s_batteryVoltStr);
+
+	// Volts = reading * (3.3 / 1024) * ((470 + 100) / 100), so centivolts = reading * 1881 / 1024
+	accum->writeFixed(FIXED_MulDiv(reading, 1881, 1024), 2);
 }
@@ -4,8 +4,13 @@
 // Defines
 #define BATT_VOLTAGE_PIN A1   // The battery voltage with a potential divider (470k//100k)
 
+// Record fields (see fields.h). The battery is always recorded, so it has no binary field flag.
+#define BATTERY_FIELDS(FIELD) \
+  FIELD(0, "Batt V", 2, BATT_UpdateBatteryVoltage, BATT_GetReading(), BATT_WriteVoltageToBuffer)
+
 // Public Functions
 void BATT_UpdateBatteryVoltage(void);
-void BATT_WriteVoltageToBuffer(FixedLengthAccumulator * accum);
+uint16_t BATT_GetReading(void);
+void BATT_WriteVoltageToBuffer(uint16_t reading, FixedLengthAccumulator * accum);
 
 #endif
@@ -0,0 +1,256 @@
+#ifndef _BINARY_RECORD_H_
+#define _BINARY_RECORD_H_
+
+/*
+ * binary_record.h
+ *
+ * Layout of the binary data files written when SD_BINARY_FORMAT is 1.
+ * This file is shared with the host-side decoder (Software/HostTools/wlconvert),
+ * so it must only depend on the standard C headers.
+ *
+ * A binary file starts with a binary_file_header, followed by fixed-size records.
+ * Each record is BINARY_RECORD_MARKER and the packed timestamp, followed by each field
+ * flagged in the header (in this order):
+ *
+ *   BINARY_FIELD_WINDSPEED       2 x 24-bit pulse counts
+ *   BINARY_FIELD_WIND_DIRECTION  8-bit direction index (0 = N, 1 = NE ... 7 = NW)
+ *   BINARY_FIELD_TEMPERATURE     16-bit thermistor ADC reading
+ *   BINARY_FIELD_IRRADIANCE      16-bit ADC reading
+ *   BINARY_FIELD_EXTERNAL_VOLTS  16-bit ADC reading
+ *   BINARY_FIELD_EXTERNAL_AMPS   16-bit sum of 20 ADC readings
+ *
+ * and finally the 16-bit battery ADC reading.
+ * If BINARY_FIELD_CHECKED is set, every record then ends with a 32-bit sequence
+ * number and a CRC-16 (BINARY_Crc16) of all the bytes before it.
+ * Records that were stored while the SD card was absent and written later start
+ * with BINARY_BACKFILL_MARKER instead (BINARY_FIELD_BACKFILLED is set in the header
+ * when the logger can write these).
+ * All values are little-endian. Records never straddle a 512-byte sector: if a record
+ * will not fit in the rest of a sector, the rest of the sector is filled with zeros.
+ *
+ * Delta-encoded files (SD_DELTA_ENCODING) start with BINARY_DELTA_MAGIC instead.
+ * The first record in each sector is always a full record as above (a keyframe),
+ * so each sector can be decoded on its own. Any other record may be a delta record:
+ *
+ *   varint zigzag(seconds since the previous record - sample time) + 1
+ *   one varint per value above, holding zigzag(value - previous value)
+ *
+ * Varints are unsigned LEB128 (7 bits per byte, least significant first).
+ * If BINARY_FIELD_CHECKED is set, a delta record ends with a CRC-16 of its other bytes,
+ * and its sequence number is always one more than the previous record's.
+ * Backfilled records are never delta encoded.
+ * A delta record never starts with 0x00, 0xFF, BINARY_RECORD_MARKER or BINARY_BACKFILL_MARKER,
+ * so it can always be told apart from a keyframe, padding or an erased sector.
+ *
+ * Raw stream files (SD_RAW_STREAM, .raw) start with a binary_file_header with BINARY_RAW_MAGIC,
+ * followed by fixed-size binary_raw_chunk records. Each chunk holds up to BINARY_RAW_SECONDS
+ * consecutive seconds, starting at its timestamp, of the pulses counted by each anemometer
+ * (up to 255) and the wind vane direction index (BINARY_RAW_NO_DIRECTION for a bad reading).
+ * Unused seconds at the end of a chunk are zero. Chunks may straddle sectors.
+ */
+
+#include <stdint.h>
+
+/*
+ * Defines and typedefs
+ */
+
+#define BINARY_FORMAT_VERSION 1
+
+#define BINARY_HEADER_MAGIC "WLB"
+#define BINARY_DELTA_MAGIC "WLD"
+#define BINARY_RAW_MAGIC "WLR"
+#define BINARY_RECORD_MARKER 0xA5
+#define BINARY_BACKFILL_MARKER 0xA6
+#define BINARY_SECTOR_SIZE 512
+
+#define BINARY_MAX_VALUES 8 // Two pulse counts, direction, four ADC readings and battery
+#define BINARY_MAX_RECORD_SIZE (1 + 4 + (BINARY_MAX_VALUES * 3) + 6)
+#define BINARY_MAX_DELTA_SIZE (5 + (BINARY_MAX_VALUES * 4) + 2)
+
+#define BINARY_CRC16_INIT 0xFFFF
+
+enum binary_field_flags
+{
+	BINARY_FIELD_WINDSPEED = 0x01,
+	BINARY_FIELD_WIND_DIRECTION = 0x02,
+	BINARY_FIELD_TEMPERATURE = 0x04,
+	BINARY_FIELD_IRRADIANCE = 0x08,
+	BINARY_FIELD_EXTERNAL_VOLTS = 0x10,
+	BINARY_FIELD_EXTERNAL_AMPS = 0x20,
+	BINARY_FIELD_BACKFILLED = 0x40, // Taken from the record marker (no extra bytes in the record)
+	BINARY_FIELD_CHECKED = 0x80 // Sequence number and CRC-16 at the end of each record
+};
+
+struct binary_file_header
+{
+	char magic[3];               // BINARY_HEADER_MAGIC (without terminator)
+	uint8_t version;             // BINARY_FORMAT_VERSION
+	uint8_t fields;              // binary_field_flags for the fields in each record
+	uint8_t record_size;         // Size of each record in bytes
+	char device_id[2];
+	uint32_t sample_time;        // Seconds between records
+	uint16_t r1;                 // External voltage divider top resistor (k Ohm)
+	uint16_t r2;                 // External voltage divider bottom resistor (k Ohm)
+	uint16_t current_offset;     // ADC reading at 0A
+	uint16_t current_gain;
+	float thermistor_b;
+	float thermistor_t0;
+	float thermistor_r0;
+	float thermistor_balance;
+} __attribute__((packed));
+
+#define BINARY_RAW_SECONDS 32
+#define BINARY_RAW_NO_DIRECTION 0xFF
+
+struct binary_raw_second
+{
+	uint8_t pulses[2];           // Pulses from each anemometer in this second
+	uint8_t direction;           // Direction index (0 = N, 1 = NE ... 7 = NW)
+} __attribute__((packed));
+
+struct binary_raw_chunk
+{
+	uint32_t timestamp;          // Packed timestamp of the first second
+	uint8_t count;               // Seconds used (1 to BINARY_RAW_SECONDS)
+	struct binary_raw_second seconds[BINARY_RAW_SECONDS];
+} __attribute__((packed));
+
+/*
+ * Timestamps are packed into 32 bits:
+ * bits 31-26 years since 2000, 25-22 month, 21-17 day, 16-12 hour, 11-6 minute, 5-0 second
+ */
+#define BINARY_PACK_TIMESTAMP(y, mo, d, h, mi, s) \
+	(((uint32_t)(y) << 26) | ((uint32_t)(mo) << 22) | ((uint32_t)(d) << 17) | \
+	((uint32_t)(h) << 12) | ((uint32_t)(mi) << 6) | (uint32_t)(s))
+
+#define BINARY_TIMESTAMP_YEAR(t) (((t) >> 26) & 0x3F)
+#define BINARY_TIMESTAMP_MONTH(t) (((t) >> 22) & 0x0F)
+#define BINARY_TIMESTAMP_DAY(t) (((t) >> 17) & 0x1F)
+#define BINARY_TIMESTAMP_HOUR(t) (((t) >> 12) & 0x1F)
+#define BINARY_TIMESTAMP_MINUTE(t) (((t) >> 6) & 0x3F)
+#define BINARY_TIMESTAMP_SECOND(t) ((t) & 0x3F)
+
+/*
+ * BINARY_RecordSize
+ * Returns the size of a record containing the flagged fields
+ */
+static inline uint8_t BINARY_RecordSize(uint8_t fields)
+{
+	uint8_t size = 1 + 4 + 2; // Marker, timestamp and battery
+	if (fields & BINARY_FIELD_WINDSPEED) { size += 6; }
+	if (fields & BINARY_FIELD_WIND_DIRECTION) { size += 1; }
+	if (fields & BINARY_FIELD_TEMPERATURE) { size += 2; }
+	if (fields & BINARY_FIELD_IRRADIANCE) { size += 2; }
+	if (fields & BINARY_FIELD_EXTERNAL_VOLTS) { size += 2; }
+	if (fields & BINARY_FIELD_EXTERNAL_AMPS) { size += 2; }
+	if (fields & BINARY_FIELD_CHECKED) { size += 4 + 2; }
+	return size;
+}
+
+/*
+ * BINARY_Crc16
+ * Updates crc (start with BINARY_CRC16_INIT) with length bytes of data.
+ * This is CRC-16/CCITT-FALSE (polynomial 0x1021), which is also used for the CSV CRC column.
+ */
+static inline uint16_t BINARY_Crc16(uint16_t crc, const uint8_t * data, uint16_t length)
+{
+	while (length--)
+	{
+		crc ^= (uint16_t)(*data++) << 8;
+		for (uint8_t i = 0; i < 8; i++)
+		{
+			crc = (crc & 0x8000) ? ((crc << 1) ^ 0x1021) : (crc << 1);
+		}
+	}
+	return crc;
+}
+
+/*
+ * BINARY_IsRecordMarker
+ * Returns true if value starts a full record
+ */
+static inline bool BINARY_IsRecordMarker(uint8_t value)
+{
+	return (value == BINARY_RECORD_MARKER) || (value == BINARY_BACKFILL_MARKER);
+}
+
+/*
+ * BINARY_GetLittleEndian
+ * Returns the count-byte little-endian value at data
+ */
+static inline uint32_t BINARY_GetLittleEndian(const uint8_t * data, uint8_t count)
+{
+	uint32_t value = 0;
+	while (count--)
+	{
+		value = (value << 8) | data[count];
+	}
+	return value;
+}
+
+/*
+ * BINARY_GetValueWidths
+ * Fills widths with the size in bytes of each value that follows the timestamp
+ * in a record containing the flagged fields, and returns the number of values
+ */
+static inline uint8_t BINARY_GetValueWidths(uint8_t fields, uint8_t * widths)
+{
+	uint8_t count = 0;
+	if (fields & BINARY_FIELD_WINDSPEED) { widths[count++] = 3; widths[count++] = 3; }
+	if (fields & BINARY_FIELD_WIND_DIRECTION) { widths[count++] = 1; }
+	if (fields & BINARY_FIELD_TEMPERATURE) { widths[count++] = 2; }
+	if (fields & BINARY_FIELD_IRRADIANCE) { widths[count++] = 2; }
+	if (fields & BINARY_FIELD_EXTERNAL_VOLTS) { widths[count++] = 2; }
+	if (fields & BINARY_FIELD_EXTERNAL_AMPS) { widths[count++] = 2; }
+	widths[count++] = 2; // Battery
+	return count;
+}
+
+/*
+ * BINARY_TimestampSeconds
+ * Returns the number of seconds since midnight for a packed timestamp
+ */
+static inline int32_t BINARY_TimestampSeconds(uint32_t timestamp)
+{
+	return ((int32_t)BINARY_TIMESTAMP_HOUR(timestamp) * 3600) +
+		((int32_t)BINARY_TIMESTAMP_MINUTE(timestamp) * 60) +
+		(int32_t)BINARY_TIMESTAMP_SECOND(timestamp);
+}
+
+static inline uint32_t BINARY_ZigZag(int32_t value)
+{
+	return ((uint32_t)value << 1) ^ (uint32_t)(value >> 31);
+}
+
+static inline int32_t BINARY_UnZigZag(uint32_t value)
+{
+	return (int32_t)(value >> 1) ^ -(int32_t)(value & 1);
+}
+
+/*
+ * BINARY_DeltaRecordLength
+ * Returns the length of the delta record at data, or 0 if it is incomplete
+ * in the available bytes
+ */
+static inline uint8_t BINARY_DeltaRecordLength(const uint8_t * data, uint16_t available, uint8_t fields)
+{
+	uint8_t widths[BINARY_MAX_VALUES];
+	uint8_t varints = 1 + BINARY_GetValueWidths(fields, widths);
+	uint16_t length = 0;
+
+	while (varints)
+	{
+		if (length >= available) { return 0; }
+		if ((data[length++] & 0x80) == 0) { varints--; }
+	}
+
+	if (fields & BINARY_FIELD_CHECKED)
+	{
+		length += 2;
+		if (length > available) { return 0; }
+	}
+	return (uint8_t)length;
+}
+
+#endif
@@ -0,0 +1,185 @@
+/*
+ * card_space.cpp
+ *
+ * SD card free space tracking for Wind Data logger.
+ *
+ * Counting the free clusters means reading the whole FAT, which can take seconds on a large card.
+ * So the count is only refreshed (by sd.cpp) when the card is initialised and once a day.
+ * In between, the free space is reduced by the bytes written to the card.
+ *
+ * The bytes written and the logging time they covered give the rate the card is filling,
+ * and so the days left. Both are halved every week so the rate follows changes to the sample time.
+ *
+ * The policy (and the free space to keep) is stored in EEPROM.
+ *
+ * James Fowkes
+ */
+
+#include <Arduino.h>
+
+/*
+ * Application Includes
+ */
+
+#include "app.h"
+#include "utility.h"
+#include "eeprom_storage.h"
+#include "card_space.h"
+
+/*
+ * Defines
+ */
+
+#define SPACE_RATE_WINDOW_SECONDS (7UL * 86400UL)
+
+/* 
+ * Private Variables
+ */
+
+static uint8_t s_policy = SPACE_KEEP;
+static uint16_t s_thresholdMB = SPACE_DEFAULT_THRESHOLD_MB;
+
+static uint32_t s_freeKB = 0;
+static uint16_t s_partKB = 0; // Bytes written since the free space last went down by 1KB
+
+static uint32_t s_bytes = 0; // Bytes written over s_seconds of logging
+static uint32_t s_seconds = 0;
+
+const char s_pstr_free[] PROGMEM = "Free KB:";
+const char s_pstr_days[] PROGMEM = "Days left:";
+const char s_pstr_policy[] PROGMEM = "Space policy:";
+
+/* 
+ * Public Functions
+ */
+
+/*
+ * SPACE_Setup
+ * Reads the policy from EEPROM
+ */
+void SPACE_Setup(void)
+{
+	s_policy = EEPROM_GetSpacePolicy();
+	s_thresholdMB = EEPROM_GetSpaceThresholdMB();
+
+	// Unprogrammed EEPROM reads as 0xFF
+	if (s_policy > SPACE_DELETE_OLDEST) { s_policy = SPACE_KEEP; }
+	if ((s_thresholdMB == 0) || (s_thresholdMB == 0xFFFF)) { s_thresholdMB = SPACE_DEFAULT_THRESHOLD_MB; }
+}
+
+/*
+ * SPACE_SetPolicy
+ * Changes (and stores) the policy. A threshold of 0 keeps the current one.
+ */
+void SPACE_SetPolicy(uint8_t policy, uint16_t threshold_mb)
+{
+	if (policy > SPACE_DELETE_OLDEST) { return; }
+
+	s_policy = policy;
+	if (threshold_mb) { s_thresholdMB = threshold_mb; }
+
+	EEPROM_SetSpacePolicy(s_policy);
+	EEPROM_SetSpaceThresholdMB(s_thresholdMB);
+}
+
+uint8_t SPACE_GetPolicy(void)
+{
+	return s_policy;
+}
+
+uint16_t SPACE_GetThresholdMB(void)
+{
+	return s_thresholdMB;
+}
+
+/*
+ * SPACE_SetFreeKB
+ * Sets the free space from a count of the free clusters
+ */
+void SPACE_SetFreeKB(uint32_t free_kb)
+{
+	s_freeKB = free_kb;
+	s_partKB = 0;
+}
+
+/*
+ * SPACE_AddFreedKB
+ * Adds the space freed by deleting a file
+ */
+void SPACE_AddFreedKB(uint32_t kb)
+{
+	s_freeKB += kb;
+}
+
+/*
+ * SPACE_AddBytesWritten
+ * Takes bytes written to the card off the free space
+ */
+void SPACE_AddBytesWritten(uint16_t bytes)
+{
+	uint32_t total = (uint32_t)s_partKB + bytes;
+	uint32_t kb = total / 1024;
+
+	s_partKB = total % 1024;
+	s_freeKB = (s_freeKB > kb) ? (s_freeKB - kb) : 0;
+	s_bytes += bytes;
+}
+
+/*
+ * SPACE_AddSeconds
+ * Adds the logging time covered by the bytes written
+ */
+void SPACE_AddSeconds(uint32_t seconds)
+{
+	s_seconds += seconds;
+
+	if (s_seconds > SPACE_RATE_WINDOW_SECONDS)
+	{
+		s_seconds /= 2;
+		s_bytes /= 2;
+	}
+}
+
+uint32_t SPACE_GetFreeKB(void)
+{
+	return s_freeKB;
+}
+
+/*
+ * SPACE_IsLow
+ * Returns true if the free space is below the threshold
+ */
+bool SPACE_IsLow(void)
+{
+	return s_freeKB < ((uint32_t)s_thresholdMB * 1024UL);
+}
+
+/*
+ * SPACE_GetDaysRemaining
+ * Returns the number of days until the card is full at the current rate
+ */
+uint16_t SPACE_GetDaysRemaining(void)
+{
+	if ((s_bytes == 0) || (s_seconds == 0)) { return SPACE_UNKNOWN_DAYS; }
+
+	float bytes_per_day = ((float)s_bytes / (float)s_seconds) * 86400.0f;
+	float days = ((float)s_freeKB * 1024.0f) / bytes_per_day;
+
+	return (days < (float)(SPACE_UNKNOWN_DAYS - 1)) ? (uint16_t)days : (SPACE_UNKNOWN_DAYS - 1);
+}
+
+/*
+ * SPACE_Print
+ * Prints the free space, days left and policy to serial
+ */
+void SPACE_Print(void)
+{
+	Serial.print(FLASH_STRING(s_pstr_free));
+	Serial.println(s_freeKB);
+	Serial.print(FLASH_STRING(s_pstr_days));
+	Serial.println(SPACE_GetDaysRemaining());
+	Serial.print(FLASH_STRING(s_pstr_policy));
+	Serial.print(s_policy);
+	Serial.print(' ');
+	Serial.println(s_thresholdMB);
+}
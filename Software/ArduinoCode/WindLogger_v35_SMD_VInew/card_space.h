@@ -0,0 +1,32 @@
+#ifndef _CARD_SPACE_H_
+#define _CARD_SPACE_H_
+
+// Defines
+#define SPACE_DEFAULT_THRESHOLD_MB 64 // Free space to keep if none has been set
+#define SPACE_UNKNOWN_DAYS 0xFFFF // Nothing has been written yet to estimate the rate from
+
+enum space_policy
+{
+	SPACE_KEEP, // Never delete anything (logging stops when the card is full)
+	SPACE_DELETE_OLDEST // Delete the oldest day's data files when free space is below the threshold
+};
+
+// Public Functions
+void SPACE_Setup(void);
+void SPACE_SetPolicy(uint8_t policy, uint16_t threshold_mb);
+
+uint8_t SPACE_GetPolicy(void);
+uint16_t SPACE_GetThresholdMB(void);
+
+void SPACE_SetFreeKB(uint32_t free_kb);
+void SPACE_AddFreedKB(uint32_t kb);
+void SPACE_AddBytesWritten(uint16_t bytes);
+void SPACE_AddSeconds(uint32_t seconds);
+
+uint32_t SPACE_GetFreeKB(void);
+bool SPACE_IsLow(void);
+uint16_t SPACE_GetDaysRemaining(void);
+
+void SPACE_Print(void);
+
+#endif
@@ -0,0 +1,213 @@
+/*
+ * daily_summary.cpp
+ *
+ * Daily summary for Wind Data logger.
+ *
+ * Every record (including records taken while the SD card is absent) is added to running
+ * totals for the day. When the first record of a new day arrives, the totals for the day
+ * before are kept until one summary row has been written to SUMMARY.csv.
+ * The totals are only kept in RAM, so a reset during the day starts them again
+ * (the Records column shows how much of the day was covered).
+ *
+ * James Fowkes
+ */
+
+#include <Arduino.h>
+
+/*
+ * Application Includes
+ */
+
+#include "app.h"
+#include "utility.h"
+#include "battery.h"
+#include "wind.h"
+#include "binary_record.h"
+#include "fixed_point.h"
+#include "daily_summary.h"
+
+#if SD_DAILY_SUMMARY == 1
+
+/*
+ * Defines and typedefs
+ */
+
+#define SUMMARY_NO_DAY 0 // Not a valid date
+
+struct summary
+{
+	uint32_t day;                // Timestamp with the time bits cleared
+	uint32_t records;
+	uint32_t seconds;            // Total of the sample times
+#if READ_WINDSPEED == 1
+	uint32_t pulses[2];
+	uint32_t max_pulses[2];      // Largest count in one record
+#endif
+#if READ_WIND_DIRECTION == 1
+	uint32_t directions[8];      // Records with each direction
+#endif
+	uint16_t min_battery;        // ADC readings
+	uint16_t max_battery;
+};
+
+/* 
+ * Private Variables
+ */
+
+static struct summary s_today; // Day is SUMMARY_NO_DAY until the first record
+static struct summary s_finished; // Waiting to be written to the card
+
+const char s_pstr_summary_headers[] PROGMEM = \
+	"Ref, Date, Records, Seconds, " \
+	WINDSPEED_SUMMARY_HEADERS \
+	WIND_DIRECTION_SUMMARY_HEADERS \
+	"Min Batt V, Max Batt V";
+
+/* 
+ * Private Functions
+ */
+
+static void startDay(uint32_t day)
+{
+	memset(&s_today, 0, sizeof(s_today));
+	s_today.day = day;
+	s_today.min_battery = 0xFFFF;
+}
+
+static void write_two_digits(uint8_t value, FixedLengthAccumulator * accum)
+{
+	accum->writeChar('0' + (value / 10));
+	accum->writeChar('0' + (value % 10));
+}
+
+/* 
+ * Public Functions
+ */
+
+/*
+ * SUMMARY_AddRecord
+ * Adds the latest readings (over seconds seconds) to the totals for the day of the timestamp.
+ * Only the readings for the fields being recorded (binary_field_flags) are up to date.
+ */
+void SUMMARY_AddRecord(uint32_t timestamp, uint32_t seconds, uint8_t fields)
+{
+	uint32_t day = timestamp & ~0x1FFFFUL;
+
+	if (day != s_today.day)
+	{
+		// A finished day not yet written (no card all day) is replaced
+		if (s_today.records) { s_finished = s_today; }
+		startDay(day);
+	}
+
+	s_today.records++;
+	s_today.seconds += seconds;
+	(void)fields; // Only used by the wind fields
+
+#if READ_WINDSPEED == 1
+	for (uint8_t i = 0; (i < 2) && (fields & BINARY_FIELD_WINDSPEED); i++)
+	{
+		uint32_t pulses = WIND_GetStoredPulseCount(i);
+		s_today.pulses[i] += pulses;
+		if (pulses > s_today.max_pulses[i]) { s_today.max_pulses[i] = pulses; }
+	}
+#endif
+
+#if READ_WIND_DIRECTION == 1
+	if (fields & BINARY_FIELD_WIND_DIRECTION) { s_today.directions[WIND_GetDirectionIndex() & 0x07]++; }
+#endif
+
+	uint16_t battery = BATT_GetReading();
+	if (battery < s_today.min_battery) { s_today.min_battery = battery; }
+	if (battery > s_today.max_battery) { s_today.max_battery = battery; }
+}
+
+/*
+ * SUMMARY_IsPending
+ * Returns true if a finished day is waiting to be written
+ */
+bool SUMMARY_IsPending(void)
+{
+	return s_finished.day != SUMMARY_NO_DAY;
+}
+
+/*
+ * SUMMARY_WriteHeaders
+ * Writes the SUMMARY.csv header line to the accumulator
+ */
+void SUMMARY_WriteHeaders(FixedLengthAccumulator * accum)
+{
+	accum->writeString_P(s_pstr_summary_headers);
+	accum->write("\r\n", 2);
+}
+
+/*
+ * SUMMARY_WriteRow
+ * Writes the summary line for the finished day to the accumulator.
+ * Mean wind is the average pulses per second, maximum wind is the largest pulse count in one record.
+ */
+void SUMMARY_WriteRow(const char * device_id, FixedLengthAccumulator * accum)
+{
+	accum->writeChar(device_id[0]);
+	accum->writeChar(device_id[1]);
+	accum->writeChar(',');
+	write_two_digits(BINARY_TIMESTAMP_DAY(s_finished.day), accum);
+	accum->writeChar('-');
+	write_two_digits(BINARY_TIMESTAMP_MONTH(s_finished.day), accum);
+	accum->write("-20", 3);
+	write_two_digits(BINARY_TIMESTAMP_YEAR(s_finished.day), accum);
+	accum->writeChar(',');
+	accum->writeUnsigned(s_finished.records);
+	accum->writeChar(',');
+	accum->writeUnsigned(s_finished.seconds);
+
+#if READ_WINDSPEED == 1
+	for (uint8_t i = 0; i < 2; i++)
+	{
+		// Mean pulses per second, in hundredths
+		uint32_t mean = s_finished.seconds ? FIXED_MulDiv(s_finished.pulses[i], 100, s_finished.seconds) : 0;
+		accum->writeChar(',');
+		accum->writeFixed(mean, 2);
+	}
+	for (uint8_t i = 0; i < 2; i++)
+	{
+		accum->writeChar(',');
+		accum->writeUnsigned(s_finished.max_pulses[i]);
+	}
+#endif
+
+#if READ_WIND_DIRECTION == 1
+	uint8_t dominant = 0;
+	for (uint8_t i = 1; i < 8; i++)
+	{
+		if (s_finished.directions[i] > s_finished.directions[dominant]) { dominant = i; }
+	}
+	accum->writeChar(',');
+	WIND_WriteDirectionToBuffer(dominant, accum);
+#endif
+
+	accum->writeChar(',');
+	BATT_WriteVoltageToBuffer(s_finished.min_battery, accum);
+	accum->writeChar(',');
+	BATT_WriteVoltageToBuffer(s_finished.max_battery, accum);
+	accum->write("\r\n", 2);
+}
+
+/*
+ * SUMMARY_Written
+ * Called once the finished day has been written to the card
+ */
+void SUMMARY_Written(void)
+{
+	s_finished.day = SUMMARY_NO_DAY;
+}
+
+#else
+
+void SUMMARY_AddRecord(uint32_t timestamp, uint32_t seconds, uint8_t fields) { (void)timestamp; (void)seconds; (void)fields; }
+bool SUMMARY_IsPending(void) { return false; }
+void SUMMARY_WriteHeaders(FixedLengthAccumulator * accum) { (void)accum; }
+void SUMMARY_WriteRow(const char * device_id, FixedLengthAccumulator * accum) { (void)device_id; (void)accum; }
+void SUMMARY_Written(void) {}
+
+#endif
@@ -0,0 +1,15 @@
+#ifndef _DAILY_SUMMARY_H_
+#define _DAILY_SUMMARY_H_
+
+// Defines
+#define SUMMARY_FILENAME "SUMMARY.csv"
+
+// Public Functions
+void SUMMARY_AddRecord(uint32_t timestamp, uint32_t seconds, uint8_t fields);
+
+bool SUMMARY_IsPending(void);
+void SUMMARY_WriteHeaders(FixedLengthAccumulator * accum);
+void SUMMARY_WriteRow(const char * device_id, FixedLengthAccumulator * accum);
+void SUMMARY_Written(void);
+
+#endif
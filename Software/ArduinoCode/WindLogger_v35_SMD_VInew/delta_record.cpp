@@ -0,0 +1,130 @@
+/*
+ * delta_record.cpp
+ *
+ * Delta/varint encoding of binary records for Wind Data logger
+ * (see binary_record.h for the format)
+ *
+ * James Fowkes
+ */
+
+#include <Arduino.h>
+
+/*
+ * Application Includes
+ */
+
+#include "app.h"
+#include "binary_record.h"
+#include "delta_record.h"
+
+#if SD_DELTA_ENCODING == 1
+
+/* 
+ * Private Variables
+ */
+
+static char s_reference[BINARY_MAX_RECORD_SIZE]; // The last record written (deltas are against this)
+static bool s_haveReference = false;
+
+/* 
+ * Private Functions
+ */
+
+static char * put_varint(char * buffer, uint32_t value)
+{
+	while (value >= 0x80)
+	{
+		*buffer++ = (char)((value & 0x7F) | 0x80);
+		value >>= 7;
+	}
+	*buffer++ = (char)value;
+	return buffer;
+}
+
+/* 
+ * Public Functions
+ */
+
+/* 
+ * DELTA_Reset
+ * Forgets the reference record, so that the next record must be a keyframe
+ */
+void DELTA_Reset(void)
+{
+	s_haveReference = false;
+}
+
+/* 
+ * DELTA_SetReference
+ * Stores the record that the next delta will be encoded against
+ */
+void DELTA_SetReference(const char * record, uint8_t length)
+{
+	if (length > BINARY_MAX_RECORD_SIZE) { return; }
+	memcpy(s_reference, record, length);
+	s_haveReference = true;
+}
+
+/* 
+ * DELTA_Encode
+ * Encodes record as a delta against the reference record into buffer (at least BINARY_MAX_DELTA_SIZE bytes).
+ * Returns the length of the delta, or 0 if the record has to be written as a keyframe instead.
+ */
+uint8_t DELTA_Encode(const char * record, uint8_t fields, uint32_t sample_time, char * buffer)
+{
+	uint8_t widths[BINARY_MAX_VALUES];
+	uint8_t count;
+	char * p = buffer;
+
+	if (!s_haveReference) { return 0; }
+
+	if (fields & BINARY_FIELD_CHECKED)
+	{
+		// The sequence number of a delta record is implied, so it must follow on from the reference
+		uint8_t sequence_offset = BINARY_RecordSize(fields) - 6;
+		uint32_t sequence = BINARY_GetLittleEndian((const uint8_t*)&record[sequence_offset], 4);
+		uint32_t reference_sequence = BINARY_GetLittleEndian((const uint8_t*)&s_reference[sequence_offset], 4);
+		if (sequence != (reference_sequence + 1)) { return 0; }
+	}
+
+	int32_t seconds = BINARY_TimestampSeconds(BINARY_GetLittleEndian((const uint8_t*)&record[1], 4));
+	int32_t reference_seconds = BINARY_TimestampSeconds(BINARY_GetLittleEndian((const uint8_t*)&s_reference[1], 4));
+
+	// Records either side of midnight go in different files, so a negative step means the clock was changed
+	p = put_varint(p, BINARY_ZigZag(seconds - reference_seconds - (int32_t)sample_time) + 1);
+
+	uint8_t first = (uint8_t)buffer[0];
+	if ((first == 0xFF) || BINARY_IsRecordMarker(first)) { return 0; }
+
+	count = BINARY_GetValueWidths(fields, widths);
+
+	uint8_t offset = 1 + 4;
+	for (uint8_t i = 0; i < count; i++)
+	{
+		int32_t value = (int32_t)BINARY_GetLittleEndian((const uint8_t*)&record[offset], widths[i]);
+		int32_t reference = (int32_t)BINARY_GetLittleEndian((const uint8_t*)&s_reference[offset], widths[i]);
+		p = put_varint(p, BINARY_ZigZag(value - reference));
+		offset += widths[i];
+	}
+
+	if (fields & BINARY_FIELD_CHECKED)
+	{
+		uint16_t crc = BINARY_Crc16(BINARY_CRC16_INIT, (const uint8_t*)buffer, p - buffer);
+		*p++ = (char)(crc & 0xFF);
+		*p++ = (char)(crc >> 8);
+	}
+
+	return (uint8_t)(p - buffer);
+}
+
+#else
+
+void DELTA_Reset(void) {}
+void DELTA_SetReference(const char * record, uint8_t length) {(void)record; (void)length;}
+uint8_t DELTA_Encode(const char * record, uint8_t fields, uint32_t sample_time, char * buffer)
+{
+	(void)record; (void)fields; (void)sample_time; (void)buffer;
+	return 0;
+}
+
+#endif
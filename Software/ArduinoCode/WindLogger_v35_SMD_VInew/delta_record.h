@@ -0,0 +1,9 @@
+#ifndef _DELTA_RECORD_H_
+#define _DELTA_RECORD_H_
+
+// Public Functions
+void DELTA_Reset(void);
+void DELTA_SetReference(const char * record, uint8_t length);
+uint8_t DELTA_Encode(const char * record, uint8_t fields, uint32_t sample_time, char * buffer);
+
+#endif
@@ -11,10 +11,14 @@
 #include <Arduino.h>
 #include <EEPROM.h>
 
+#include "eeprom_storage.h"
+
 /*
  * Defines and Typedefs
  */
 
+#define EEPROM_SIZE 1024 // ATMEGA328P
+
 /*
  * An enumeration of the EEPROM storage locations.
  * Byte-wise indexing, so take datatype length into account
@@ -28,7 +32,19 @@ enum eeprom_locations_enum
 	LOC_R1 = 6,
 	LOC_R2 = 8,
 	LOC_CURRENT_GAIN = 10,
-	LOC_WINDVANE_POSITION = 12
+	LOC_WINDVANE_POSITION = 12,
+	LOC_SYNC_RECORDS = 13,
+	LOC_UNUSED_15 = 15, // 15 to 18 were the backfill head and count (now found from the slot tags)
+	LOC_BACKFILL_RECORD_SIZE = 19,
+	LOC_SEQUENCE_RESERVED = 20,
+	LOC_ROTATION_MODE = 24,
+	LOC_ROTATION_MAX_KB = 25,
+	LOC_SPACE_POLICY = 27,
+	LOC_SPACE_THRESHOLD_MB = 28,
+	LOC_SPI_DIVISOR = 30,
+	LOC_FIELD_MASK = 31,
+	LOC_DEBOUNCE_MS = 32,
+	LOC_BACKFILL_START = 128 // Records stored while the SD card is absent fill the rest of the EEPROM
 };
 
 /*
@@ -123,3 +139,166 @@ void EEPROM_SetWindwavePosition(bool set)
 {
 	EEPROM.write(LOC_WINDVANE_POSITION, (char)set);	
 }
+
+uint16_t EEPROM_GetSyncRecords(void)
+{
+	return (EEPROM.read(LOC_SYNC_RECORDS) << 8) + EEPROM.read(LOC_SYNC_RECORDS+1);
+}
+
+void EEPROM_SetSyncRecords(uint16_t records)
+{
+    EEPROM.write(LOC_SYNC_RECORDS, records >> 8);
+    EEPROM.write(LOC_SYNC_RECORDS+1, records & 0xff);
+}
+
+uint8_t EEPROM_GetBackfillRecordSize(void)
+{
+	return EEPROM.read(LOC_BACKFILL_RECORD_SIZE);
+}
+
+void EEPROM_SetBackfillRecordSize(uint8_t size)
+{
+	EEPROM.update(LOC_BACKFILL_RECORD_SIZE, size);
+}
+
+uint32_t EEPROM_GetSequenceReserved(void)
+{
+	uint32_t sequence = 0;
+	for (uint8_t i = 0; i < 4; i++)
+	{
+		sequence = (sequence << 8) + EEPROM.read(LOC_SEQUENCE_RESERVED+i);
+	}
+	return sequence;
+}
+
+void EEPROM_SetSequenceReserved(uint32_t sequence)
+{
+	for (uint8_t i = 0; i < 4; i++)
+	{
+		EEPROM.write(LOC_SEQUENCE_RESERVED+i, (sequence >> (24 - (8 * i))) & 0xff);
+	}
+}
+
+uint8_t EEPROM_GetRotationMode(void)
+{
+	return EEPROM.read(LOC_ROTATION_MODE);
+}
+
+void EEPROM_SetRotationMode(uint8_t mode)
+{
+	EEPROM.write(LOC_ROTATION_MODE, mode);
+}
+
+uint16_t EEPROM_GetRotationMaxKB(void)
+{
+	return (EEPROM.read(LOC_ROTATION_MAX_KB) << 8) + EEPROM.read(LOC_ROTATION_MAX_KB+1);
+}
+
+void EEPROM_SetRotationMaxKB(uint16_t max_kb)
+{
+    EEPROM.write(LOC_ROTATION_MAX_KB, max_kb >> 8);
+    EEPROM.write(LOC_ROTATION_MAX_KB+1, max_kb & 0xff);
+}
+
+uint8_t EEPROM_GetSpacePolicy(void)
+{
+	return EEPROM.read(LOC_SPACE_POLICY);
+}
+
+void EEPROM_SetSpacePolicy(uint8_t policy)
+{
+	EEPROM.write(LOC_SPACE_POLICY, policy);
+}
+
+uint16_t EEPROM_GetSpaceThresholdMB(void)
+{
+	return (EEPROM.read(LOC_SPACE_THRESHOLD_MB) << 8) + EEPROM.read(LOC_SPACE_THRESHOLD_MB+1);
+}
+
+void EEPROM_SetSpaceThresholdMB(uint16_t threshold_mb)
+{
+    EEPROM.write(LOC_SPACE_THRESHOLD_MB, threshold_mb >> 8);
+    EEPROM.write(LOC_SPACE_THRESHOLD_MB+1, threshold_mb & 0xff);
+}
+
+uint8_t EEPROM_GetSpiDivisor(void)
+{
+	return EEPROM.read(LOC_SPI_DIVISOR);
+}
+
+void EEPROM_SetSpiDivisor(uint8_t divisor)
+{
+	EEPROM.write(LOC_SPI_DIVISOR, divisor);
+}
+
+uint8_t EEPROM_GetFieldMask(void)
+{
+	return EEPROM.read(LOC_FIELD_MASK);
+}
+
+void EEPROM_SetFieldMask(uint8_t mask)
+{
+	EEPROM.write(LOC_FIELD_MASK, mask);
+}
+
+uint8_t EEPROM_GetDebounceMs(void)
+{
+	return EEPROM.read(LOC_DEBOUNCE_MS);
+}
+
+void EEPROM_SetDebounceMs(uint8_t ms)
+{
+	EEPROM.write(LOC_DEBOUNCE_MS, ms);
+}
+
+/* 
+ * EEPROM_GetBackfillCapacity
+ * Returns the number of slots for records of record_size in the backfill area.
+ * Each slot is a tag byte followed by the record.
+ */
+uint16_t EEPROM_GetBackfillCapacity(uint8_t record_size)
+{
+	uint16_t slots = record_size ? ((EEPROM_SIZE - LOC_BACKFILL_START) / (record_size + 1)) : 0;
+	return (slots > EEPROM_MAX_BACKFILL_SLOTS) ? EEPROM_MAX_BACKFILL_SLOTS : slots;
+}
+
+static uint16_t backfillLocation(uint16_t slot, uint8_t record_size)
+{
+	return LOC_BACKFILL_START + (slot * (record_size + 1));
+}
+
+/* 
+ * EEPROM_ReadBackfillTag, EEPROM_WriteBackfillTag
+ * Read and write the tag of a slot in the backfill area
+ */
+uint8_t EEPROM_ReadBackfillTag(uint16_t slot, uint8_t record_size)
+{
+	return EEPROM.read(backfillLocation(slot, record_size));
+}
+
+void EEPROM_WriteBackfillTag(uint16_t slot, uint8_t record_size, uint8_t tag)
+{
+	EEPROM.update(backfillLocation(slot, record_size), tag);
+}
+
+/* 
+ * EEPROM_ReadBackfillRecord, EEPROM_WriteBackfillRecord
+ * Read and write the record in a slot of the backfill area
+ */
+void EEPROM_ReadBackfillRecord(uint16_t slot, char * record, uint8_t record_size)
+{
+	uint16_t location = backfillLocation(slot, record_size) + 1;
+	for (uint8_t i = 0; i < record_size; i++)
+	{
+		record[i] = (char)EEPROM.read(location + i);
+	}
+}
+
+void EEPROM_WriteBackfillRecord(uint16_t slot, const char * record, uint8_t record_size)
+{
+	uint16_t location = backfillLocation(slot, record_size) + 1;
+	for (uint8_t i = 0; i < record_size; i++)
+	{
+		EEPROM.update(location + i, record[i]);
+	}
+}
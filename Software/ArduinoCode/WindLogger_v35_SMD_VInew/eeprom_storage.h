@@ -1,6 +1,11 @@
 #ifndef _EEPROM_STORAGE_H_
 #define _EEPROM_STORAGE_H_
 
+// Backfill slot tags (see backfill.cpp). There are fewer slots than tags, so the oldest record can be found.
+#define EEPROM_BACKFILL_EMPTY_TAG 0xFF
+#define EEPROM_BACKFILL_TAGS 255
+#define EEPROM_MAX_BACKFILL_SLOTS 254
+
 void EEPROM_GetDeviceID(char * buffer);
 void EEPROM_SetDeviceID(char * buffer);
 
@@ -22,4 +27,40 @@ void EEPROM_SetCurrentGain(uint16_t currentGain);
 bool EEPROM_GetWindwavePosition(void);
 void EEPROM_SetWindwavePosition(bool set);
 
+uint16_t EEPROM_GetSyncRecords(void);
+void EEPROM_SetSyncRecords(uint16_t records);
+
+uint8_t EEPROM_GetBackfillRecordSize(void);
+void EEPROM_SetBackfillRecordSize(uint8_t size);
+
+uint32_t EEPROM_GetSequenceReserved(void);
+void EEPROM_SetSequenceReserved(uint32_t sequence);
+
+uint8_t EEPROM_GetRotationMode(void);
+void EEPROM_SetRotationMode(uint8_t mode);
+
+uint16_t EEPROM_GetRotationMaxKB(void);
+void EEPROM_SetRotationMaxKB(uint16_t max_kb);
+
+uint8_t EEPROM_GetSpacePolicy(void);
+void EEPROM_SetSpacePolicy(uint8_t policy);
+
+uint16_t EEPROM_GetSpaceThresholdMB(void);
+void EEPROM_SetSpaceThresholdMB(uint16_t threshold_mb);
+
+uint8_t EEPROM_GetSpiDivisor(void);
+void EEPROM_SetSpiDivisor(uint8_t divisor);
+
+uint8_t EEPROM_GetFieldMask(void);
+void EEPROM_SetFieldMask(uint8_t mask);
+
+uint8_t EEPROM_GetDebounceMs(void);
+void EEPROM_SetDebounceMs(uint8_t ms);
+
+uint16_t EEPROM_GetBackfillCapacity(uint8_t record_size);
+uint8_t EEPROM_ReadBackfillTag(uint16_t slot, uint8_t record_size);
+void EEPROM_WriteBackfillTag(uint16_t slot, uint8_t record_size, uint8_t tag);
+void EEPROM_ReadBackfillRecord(uint16_t slot, char * record, uint8_t record_size);
+void EEPROM_WriteBackfillRecord(uint16_t slot, const char * record, uint8_t record_size);
+
 #endif
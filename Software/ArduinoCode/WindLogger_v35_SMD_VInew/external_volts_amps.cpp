@@ -12,6 +12,7 @@
 
 #include "app.h"
 #include "utility.h"
+#include "fixed_point.h"
 #include "external_volts_amps.h"
 #include "eeprom_storage.h"
 
@@ -22,16 +23,13 @@
 ///********* External Voltage ****************/
 #if READ_EXTERNAL_VOLTS == 1
 static int  s_r1, s_r2;  // The potential divider values  
-static float s_externalVoltage;        // Temporary store for float
-static char  s_externalVoltStr[6];      // Hold the battery voltage as a string
+static uint16_t s_externalVoltageReading;  // ADC reading from the last update
 #endif
 
 ///********* Current 1 ****************/
 #if READ_EXTERNAL_AMPS == 1
 static long int s_currentData1;      // Temp holder for value
-static float s_current1;        // Temporary store for float
-static float s_currentOffset;  // Holds the offset current
-static char s_current1Str[7];      // Hold the current as a string
+static int s_currentOffset;  // Holds the ADC reading at 0A
 static int s_iGain;    // Holds the current conversion factor in mV/A
 #endif
 
@@ -46,8 +44,7 @@ static int s_iGain;    // Holds the current conversion factor in mV/A
  */
 void VA_SetCurrentOffset(int newOffset)
 {
-	// Convert the current offset to a voltage
-  	s_currentOffset = float(newOffset)*3.3f/1023.0f;
+	s_currentOffset = newOffset;
 }
 
 /* 
@@ -78,7 +75,7 @@ void VA_StoreNewCurrentOffset(void)
     VA_SetCurrentOffset(s_currentData1);
     
     Serial.print("Ioffset:");
-    Serial.print(s_currentOffset);
+    Serial.print(float(s_currentOffset)*3.3f/1023.0f);
     Serial.println("V");
 
     // Write the offset to EEPROM   
@@ -113,34 +110,47 @@ void VA_UpdateExternalCurrent(void)
       s_currentData1 += analogRead(CURRENT_1_PIN);
       delay(2);
     }
+}
+
+/* 
+ * VA_GetCurrentReading
+ * Returns the sum of the 20 ADC readings from the last update
+ */
+uint16_t VA_GetCurrentReading(void)
+{
+    return (uint16_t)s_currentData1;
+}
+
+/* 
+ * VA_WriteExternalCurrentToBuffer
+ * Converts a reading (from VA_GetCurrentReading) to amps and writes it to the accumulator
+ */
+void VA_WriteExternalCurrentToBuffer(uint16_t reading, FixedLengthAccumulator * accum)
+{
+    if (!accum) { return; }
+
+    // The reading is the sum of 20 ADC readings, so the voltage from the sensor (less the 0A offset) is
+    // ((reading / 20) - offset) * 3.3 / 1023 = (reading - (20 * offset)) * 11 / 68200
+    int32_t current1 = ((int32_t)reading - (20L * s_currentOffset)) * s_iGain;
 
-    s_current1 = float(s_currentData1)/20.0f;  
-    s_current1 = (s_current1*3.3f/1023.0f) - s_currentOffset;
-    // Current 1 holds the incoming voltage.
-     
     // ********** LEM HTFS 200-P SENSOR *********************************
     // Voutput is Vref +/- 1.25 * Ip/Ipn 
     // Vref = Vsupply/2 +/1 0.025V (Would be best to remove this with analog stage)
-    //s_current1 = (s_current1*200.0f)/1.25f;
-    s_current1 = s_current1*float(s_iGain);  
+    //current1 = (current1*200.0f)/1.25f;
   
 //    // ************* ACS*** Hall Effect **********************
 //    // Output is Input Voltage - offset / mV per Amp sensitivity
 //    // Datasheet says 60mV/A     
 
-    // Convert the current to a string.
-    dtostrf(s_current1,2,2, s_current1Str);     // Hold the battery voltage as a string
-}
-
-void VA_WriteExternalCurrentToBuffer(FixedLengthAccumulator * accum)
-{
-    if (!accum) { return; }
-    accum->writeString(s_current1Str);
+    // Centiamps, rounded away from zero
+    uint32_t centiamps = FIXED_MulDiv((current1 < 0) ? -current1 : current1, 11, 682);
+    accum->writeFixed((current1 < 0) ? -(int32_t)centiamps : (int32_t)centiamps, 2);
 }
 
 #else
 
 void VA_UpdateExternalCurrent(void) {}
+uint16_t VA_GetCurrentReading(void) { return 0; }
 
 void VA_SetCurrentGain(int gain) { (void)gain; } 
 void VA_SetCurrentOffset(int offset) { (void)offset; } 
@@ -148,7 +158,7 @@ void VA_SetCurrentOffset(int offset) { (void)offset; }
 void VA_StoreNewCurrentOffset(void) {} 
 void VA_StoreNewCurrentGain(int gain) { (void)gain; } 
 
-void VA_WriteExternalCurrentToBuffer(FixedLengthAccumulator * accum) {(void)accum;}
+void VA_WriteExternalCurrentToBuffer(uint16_t reading, FixedLengthAccumulator * accum) {(void)reading; (void)accum;}
 
 #endif
 
@@ -193,26 +203,42 @@ void VA_StoreNewResistor2(int value)
  */
 void VA_UpdateExternalVoltage(void)
 {
-	s_externalVoltage = float(analogRead(VOLTAGE_PIN))*(3.3f/1023.0f)*((float(s_r1)+float(s_r2))/float(s_r2));
-    dtostrf(s_externalVoltage,2,2, s_externalVoltStr);
+	s_externalVoltageReading = analogRead(VOLTAGE_PIN);
 }
 
+/* 
+ * VA_GetVoltageReading
+ * Returns the ADC reading from the last update
+ */
+uint16_t VA_GetVoltageReading(void)
+{
+    return s_externalVoltageReading;
+}
 
-void VA_WriteExternalVoltageToBuffer(FixedLengthAccumulator * accum)
+/* 
+ * VA_WriteExternalVoltageToBuffer
+ * Converts an ADC reading (from VA_GetVoltageReading) to volts and writes it to the accumulator
+ */
+void VA_WriteExternalVoltageToBuffer(uint16_t reading, FixedLengthAccumulator * accum)
 {
     if (!accum) { return; }
-    accum->writeString(s_externalVoltStr);
+
+    // Volts = reading * (3.3 / 1023) * ((r1 + r2) / r2), so centivolts = reading * (r1 + r2) * 110 / (341 * r2)
+    uint32_t r1 = (uint16_t)s_r1;
+    uint32_t r2 = (uint16_t)s_r2;
+    accum->writeFixed(r2 ? FIXED_MulDiv(reading * (r1 + r2), 110, 341 * r2) : 0, 2);
 }
 
 #else
 
 void VA_UpdateExternalVoltage(void) {}
+uint16_t VA_GetVoltageReading(void) { return 0; }
 
 void VA_StoreNewResistor1(int r1) { (void)r1; } 
 void VA_StoreNewResistor2(int r2) { (void)r2; }
 
 void VA_SetVoltageDivider(uint16_t r1, uint16_t r2) { (void)r1; (void)r2; }
 
-void VA_WriteExternalVoltageToBuffer(FixedLengthAccumulator * accum) {(void)accum;}
+void VA_WriteExternalVoltageToBuffer(uint16_t reading, FixedLengthAccumulator * accum) {(void)reading; (void)accum;}
 
 #endif
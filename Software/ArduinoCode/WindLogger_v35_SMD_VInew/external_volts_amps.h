@@ -5,16 +5,19 @@
 #define VOLTAGE_PIN A2  // The external voltage with a potential divider (680k // 46k)
 #define CURRENT_1_PIN A3  // Current from a hall effect sensor
 
+// Record fields (see fields.h)
 #if READ_EXTERNAL_AMPS == 1
-#define EXTERNAL_AMPS_HEADERS "Current, "
+#define EXTERNAL_AMPS_FIELDS(FIELD) \
+  FIELD(BINARY_FIELD_EXTERNAL_AMPS, "Current", 2, VA_UpdateExternalCurrent, VA_GetCurrentReading(), VA_WriteExternalCurrentToBuffer)
 #else
-#define EXTERNAL_AMPS_HEADERS ""
+#define EXTERNAL_AMPS_FIELDS(FIELD)
 #endif
 
 #if READ_EXTERNAL_VOLTS == 1
-#define EXTERNAL_VOLTS_HEADERS "Ext V, "
+#define EXTERNAL_VOLTS_FIELDS(FIELD) \
+  FIELD(BINARY_FIELD_EXTERNAL_VOLTS, "Ext V", 2, VA_UpdateExternalVoltage, VA_GetVoltageReading(), VA_WriteExternalVoltageToBuffer)
 #else
-#define EXTERNAL_VOLTS_HEADERS ""
+#define EXTERNAL_VOLTS_FIELDS(FIELD)
 #endif
 
 // Public Functions
@@ -31,7 +34,10 @@ void VA_StoreNewCurrentGain(int value);
 void VA_UpdateExternalVoltage(void);
 void VA_UpdateExternalCurrent(void);
 
-void VA_WriteExternalVoltageToBuffer(FixedLengthAccumulator * accum);
-void VA_WriteExternalCurrentToBuffer(FixedLengthAccumulator * accum);
+uint16_t VA_GetVoltageReading(void);
+uint16_t VA_GetCurrentReading(void);
+
+void VA_WriteExternalVoltageToBuffer(uint16_t reading, FixedLengthAccumulator * accum);
+void VA_WriteExternalCurrentToBuffer(uint16_t reading, FixedLengthAccumulator * accum);
 
 #endif
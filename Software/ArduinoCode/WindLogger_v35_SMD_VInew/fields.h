@@ -0,0 +1,66 @@
+#ifndef _FIELDS_H_
+#define _FIELDS_H_
+
+/*
+ * fields.h
+ *
+ * The table of fields in each record. The CSV header line, the readings taken for
+ * each record, the binary record layout and the CSV writer in sd.cpp are all generated
+ * from this table, so they can't get out of step.
+ *
+ * Each module header defines its entries in a <MODULE>_FIELDS(FIELD) macro, which is
+ * empty if the field is disabled in app.h (so a disabled field generates no code).
+ * Each entry is
+ *
+ *   FIELD(flag, header, width, update, reading, writer)
+ *
+ *   flag     binary_field_flags bit for the field (binary_record.h)
+ *   header   CSV column header
+ *   width    bytes used by the reading in a binary record
+ *   update   function called to take a new reading when a record is due (or FIELD_NoUpdate)
+ *            if the field is being recorded
+ *   reading  expression giving the raw reading to store in the record
+ *   writer   function that converts a raw reading and writes it to an accumulator:
+ *            writer(reading, FixedLengthAccumulator * accum)
+ *
+ * The entries are in the order of the CSV columns and of the values in a binary record,
+ * which must match the order of the flags in binary_record.h (and wlconvert).
+ *
+ * Which of the compiled-in fields are recorded is chosen at runtime by the field mask
+ * (see SD_SetFieldMask). A field with a flag of 0 is always recorded.
+ */
+
+/*
+ * Defines and typedefs
+ */
+
+#define SD_FIELDS(FIELD) \
+  WINDSPEED_FIELDS(FIELD) \
+  WIND_STATISTICS_FIELDS(FIELD) \
+  WIND_PERIOD_FIELDS(FIELD) \
+  WIND_DEBOUNCE_FIELDS(FIELD) \
+  WIND_DIRECTION_FIELDS(FIELD) \
+  WIND_VECTOR_FIELDS(FIELD) \
+  TEMPERATURE_FIELDS(FIELD) \
+  IRRADIANCE_FIELDS(FIELD) \
+  EXTERNAL_VOLTS_FIELDS(FIELD) \
+  EXTERNAL_AMPS_FIELDS(FIELD) \
+  BATTERY_FIELDS(FIELD)
+
+// True if the field with flag is in fields (a set of binary_field_flags)
+#define FIELD_IS_IN(fields, flag) (((flag) == 0) || ((fields) & (flag)))
+
+// For a field that is updated by another entry of the same module
+static inline void FIELD_NoUpdate(void) {}
+
+// Generators for use with SD_FIELDS
+#define FIELD_HEADER(flag, header, width, update, reading, writer) ", " header
+#define FIELD_FLAG(flag, header, width, update, reading, writer) | (flag)
+#define FIELD_FLAG_LIST(flag, header, width, update, reading, writer) (flag),
+#define FIELD_WIDTH(flag, header, width, update, reading, writer) + (width)
+
+// Takes the readings for the fields being recorded (needs uint8_t fields in scope)
+#define FIELD_UPDATE(flag, header, width, update, reading, writer) \
+  if (FIELD_IS_IN(fields, flag)) { update(); }
+
+#endif
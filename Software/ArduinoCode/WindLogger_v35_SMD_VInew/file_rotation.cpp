@@ -0,0 +1,214 @@
+/*
+ * file_rotation.cpp
+ *
+ * Data file rotation policy for Wind Data logger.
+ *
+ * A new file is started every day, every hour, or (in ROTATION_SIZE mode) every day and
+ * whenever the current file reaches a size limit. The policy is stored in EEPROM.
+ *
+ * Each file covers a period, which is a plain integer so that the write path can spot
+ * a rollover without any string handling:
+ *   day period = (year * 372) + ((month - 1) * 31) + (day - 1)
+ *   hour period = (day period * 24) + hour
+ * These are not a count of real days, but they always increase and convert straight
+ * back to a date for the filename.
+ *
+ * James Fowkes
+ */
+
+#include <Arduino.h>
+
+/*
+ * Application Includes
+ */
+
+#include "app.h"
+#include "eeprom_storage.h"
+#include "binary_record.h"
+#include "file_rotation.h"
+
+/* 
+ * Private Variables
+ */
+
+static uint8_t s_mode = ROTATION_DAILY;
+static uint16_t s_maxKB = ROTATION_DEFAULT_MAX_KB;
+
+static const uint8_t s_daysInMonth[] PROGMEM = {31, 28, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31};
+
+/* 
+ * Private Functions
+ */
+
+static uint32_t dayPeriod(uint8_t year, uint8_t month, uint8_t day)
+{
+	return ((uint32_t)year * 372) + ((uint32_t)(month - 1) * 31) + (day - 1);
+}
+
+static uint8_t daysInMonth(uint8_t year, uint8_t month)
+{
+	// Every year divisible by 4 from 2000 to 2099 is a leap year
+	if ((month == 2) && ((year % 4) == 0)) { return 29; }
+	return pgm_read_byte(&s_daysInMonth[month - 1]);
+}
+
+static char * writeTwoDigits(char * buffer, uint8_t value)
+{
+	*buffer++ = '0' + (value / 10);
+	*buffer++ = '0' + (value % 10);
+	return buffer;
+}
+
+/* 
+ * Public Functions
+ */
+
+/*
+ * ROTATION_Setup
+ * Reads the rotation policy from EEPROM
+ */
+void ROTATION_Setup(void)
+{
+	s_mode = EEPROM_GetRotationMode();
+	s_maxKB = EEPROM_GetRotationMaxKB();
+
+	// Unprogrammed EEPROM reads as 0xFF
+	if (s_mode > ROTATION_SIZE) { s_mode = ROTATION_DAILY; }
+	if ((s_maxKB == 0) || (s_maxKB == 0xFFFF)) { s_maxKB = ROTATION_DEFAULT_MAX_KB; }
+}
+
+/*
+ * ROTATION_SetMode
+ * Changes (and stores) the rotation policy. max_kb is only used in ROTATION_SIZE mode.
+ */
+void ROTATION_SetMode(uint8_t mode, uint16_t max_kb)
+{
+	if (mode > ROTATION_SIZE) { return; }
+
+	EEPROM_SetRotationMode(mode);
+	if (mode == ROTATION_SIZE) { EEPROM_SetRotationMaxKB(max_kb); }
+	ROTATION_Setup();
+}
+
+uint8_t ROTATION_GetMode(void)
+{
+	return s_mode;
+}
+
+/*
+ * ROTATION_GetMaxBytes
+ * Returns the size limit of each file (0 if files are not size-limited)
+ */
+uint32_t ROTATION_GetMaxBytes(void)
+{
+	return (s_mode == ROTATION_SIZE) ? ((uint32_t)s_maxKB * 1024UL) : 0;
+}
+
+/*
+ * ROTATION_GetPeriodSeconds
+ * Returns the longest time covered by one file
+ */
+uint32_t ROTATION_GetPeriodSeconds(void)
+{
+	return (s_mode == ROTATION_HOURLY) ? 3600UL : 86400UL;
+}
+
+/*
+ * ROTATION_GetPeriod
+ * Returns the period of a packed timestamp (see binary_record.h)
+ */
+uint32_t ROTATION_GetPeriod(uint32_t timestamp)
+{
+	uint32_t period = dayPeriod(
+		BINARY_TIMESTAMP_YEAR(timestamp), BINARY_TIMESTAMP_MONTH(timestamp), BINARY_TIMESTAMP_DAY(timestamp));
+
+	if (s_mode == ROTATION_HOURLY)
+	{
+		period = (period * 24) + BINARY_TIMESTAMP_HOUR(timestamp);
+	}
+	return period;
+}
+
+/*
+ * ROTATION_GetNextPeriod
+ * Returns the period after the given one
+ */
+uint32_t ROTATION_GetNextPeriod(uint32_t period)
+{
+	uint8_t hour = 0;
+
+	if (s_mode == ROTATION_HOURLY)
+	{
+		hour = period % 24;
+		period /= 24;
+		if (hour < 23) { return (period * 24) + hour + 1; }
+	}
+
+	uint8_t year = period / 372;
+	uint8_t month = ((period % 372) / 31) + 1;
+	uint8_t day = (period % 31) + 1;
+
+	if (day < daysInMonth(year, month))
+	{
+		day++;
+	}
+	else
+	{
+		day = 1;
+		if (++month > 12)
+		{
+			month = 1;
+			year++;
+		}
+	}
+
+	period = dayPeriod(year, month, day);
+	return (s_mode == ROTATION_HOURLY) ? (period * 24) : period;
+}
+
+/*
+ * ROTATION_GetSecondsToNextPeriod
+ * Returns the number of seconds from a packed timestamp to the start of the next period
+ */
+uint32_t ROTATION_GetSecondsToNextPeriod(uint32_t timestamp)
+{
+	uint32_t seconds = (uint32_t)BINARY_TimestampSeconds(timestamp);
+	if (s_mode == ROTATION_HOURLY) { seconds %= 3600UL; }
+	return ROTATION_GetPeriodSeconds() - seconds;
+}
+
+/*
+ * ROTATION_GetFilename
+ * Writes the 8.3 filename for a period (and part, except in ROTATION_HOURLY mode) to buffer
+ * (which must hold at least 13 characters)
+ */
+void ROTATION_GetFilename(char * buffer, uint32_t period, uint8_t part, const char * extension)
+{
+	uint8_t hour = 0;
+
+	if (s_mode == ROTATION_HOURLY)
+	{
+		hour = period % 24;
+		period /= 24;
+	}
+	else
+	{
+		*buffer++ = 'D';
+	}
+
+	buffer = writeTwoDigits(buffer, period / 372);
+	buffer = writeTwoDigits(buffer, ((period % 372) / 31) + 1);
+	buffer = writeTwoDigits(buffer, (period % 31) + 1);
+
+	if (s_mode == ROTATION_HOURLY)
+	{
+		buffer = writeTwoDigits(buffer, hour);
+	}
+	else if (part > 0)
+	{
+		*buffer++ = (part < 10) ? ('0' + part) : ('A' + part - 10);
+	}
+
+	*buffer++ = '.';
+	strcpy(buffer, extension);
+}
@@ -0,0 +1,30 @@
+#ifndef _FILE_ROTATION_H_
+#define _FILE_ROTATION_H_
+
+// Defines
+#define ROTATION_DEFAULT_MAX_KB 1024 // Size limit used if none has been set
+#define ROTATION_MAX_PARTS 36 // Files per day (DYYMMDD, then DYYMMDD1 ... DYYMMDDZ) when the size limit is reached or the fields change
+#define ROTATION_NO_PERIOD 0xFFFFFFFFUL
+
+enum rotation_mode
+{
+	ROTATION_DAILY, // DYYMMDD.csv
+	ROTATION_HOURLY, // YYMMDDHH.csv
+	ROTATION_SIZE // DYYMMDD.csv, then DYYMMDD1.csv etc. each time the size limit is reached
+};
+
+// Public Functions
+void ROTATION_Setup(void);
+void ROTATION_SetMode(uint8_t mode, uint16_t max_kb);
+
+uint8_t ROTATION_GetMode(void);
+uint32_t ROTATION_GetMaxBytes(void);
+uint32_t ROTATION_GetPeriodSeconds(void);
+
+uint32_t ROTATION_GetPeriod(uint32_t timestamp);
+uint32_t ROTATION_GetNextPeriod(uint32_t period);
+uint32_t ROTATION_GetSecondsToNextPeriod(uint32_t timestamp);
+
+void ROTATION_GetFilename(char * buffer, uint32_t period, uint8_t part, const char * extension);
+
+#endif
@@ -0,0 +1,121 @@
+#ifndef _FIXED_POINT_H_
+#define _FIXED_POINT_H_
+
+/*
+ * fixed_point.h
+ *
+ * Integer arithmetic and formatting for the values written to CSV records.
+ * Each reading is scaled to an integer number of hundredths (for example centivolts)
+ * and printed with a decimal point, instead of using float maths and dtostrf.
+ * This file is shared with the host-side decoder (Software/HostTools/wlconvert),
+ * so it must only depend on the standard C headers.
+ */
+
+#include <stdint.h>
+
+/*
+ * Defines and typedefs
+ */
+
+#define FIXED_MAX_LENGTH 12 // Sign, ten digits and the decimal point (not including a terminator)
+
+/*
+ * FIXED_MulDiv
+ * Returns value * mul / div, rounded to the nearest integer (halves round up).
+ * There is no overflow as long as div * mul fits in 32 bits.
+ */
+static inline uint32_t FIXED_MulDiv(uint32_t value, uint16_t mul, uint32_t div)
+{
+	uint32_t quotient = value / div;
+	uint32_t remainder = value % div;
+	return (quotient * mul) + (((remainder * mul) + (div / 2)) / div);
+}
+
+/*
+ * FIXED_Sqrt
+ * Returns the square root of value, rounded down (one bit of the root per loop, with no multiplies)
+ */
+static inline uint32_t FIXED_Sqrt(uint64_t value)
+{
+	uint64_t root = 0;
+	uint64_t bit = (uint64_t)1 << 62;
+
+	while (bit > value) { bit >>= 2; }
+
+	while (bit)
+	{
+		if (value >= (root + bit))
+		{
+			value -= root + bit;
+			root = (root >> 1) + bit;
+		}
+		else
+		{
+			root >>= 1;
+		}
+		bit >>= 2;
+	}
+	return (uint32_t)root;
+}
+
+/*
+ * FIXED_FormatUnsigned
+ * Writes value / 10^decimals to buffer (for example 1234 with 2 decimals is "12.34", 5 is "0.05"),
+ * followed by a terminator. Returns the number of chars written (not including the terminator).
+ * buffer must have space for FIXED_MAX_LENGTH + 1 chars.
+ */
+static inline uint8_t FIXED_FormatUnsigned(char * buffer, uint32_t value, uint8_t decimals)
+{
+	char digits[10];
+	uint8_t count = 0;
+
+	// 32-bit division is slow on an AVR, so it is only used until the value fits in 16 bits
+	while (value > 0xFFFF)
+	{
+		digits[count++] = '0' + (char)(value % 10);
+		value /= 10;
+	}
+
+	uint16_t small = (uint16_t)value;
+	do
+	{
+		digits[count++] = '0' + (char)(small % 10);
+		small /= 10;
+	} while (small || (count <= decimals));
+
+	uint8_t length = 0;
+	while (count)
+	{
+		if (count == decimals) { buffer[length++] = '.'; }
+		buffer[length++] = digits[--count];
+	}
+	buffer[length] = '\0';
+	return length;
+}
+
+/*
+ * FIXED_Format
+ * As FIXED_FormatUnsigned, for a signed value
+ */
+static inline uint8_t FIXED_Format(char * buffer, int32_t value, uint8_t decimals)
+{
+	if (value < 0)
+	{
+		buffer[0] = '-';
+		return 1 + FIXED_FormatUnsigned(buffer + 1, (uint32_t)0 - (uint32_t)value, decimals);
+	}
+	return FIXED_FormatUnsigned(buffer, (uint32_t)value, decimals);
+}
+
+/*
+ * FIXED_FromFloat
+ * Returns value * 10^decimals, rounded to the nearest integer (halves round away from zero).
+ * Only for readings that need a non-linear float conversion (the thermistor).
+ */
+static inline int32_t FIXED_FromFloat(float value, uint8_t decimals)
+{
+	while (decimals--) { value *= 10.0f; }
+	return (int32_t)((value < 0.0f) ? (value - 0.5f) : (value + 0.5f));
+}
+
+#endif
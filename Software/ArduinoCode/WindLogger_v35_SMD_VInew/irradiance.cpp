@@ -15,6 +15,7 @@
 
 #include "app.h"
 #include "utility.h"
+#include "fixed_point.h"
 
 
 #if READ_IRRADIANCE == 1
@@ -31,6 +32,8 @@
 
 const char s_pstr_irradiance_dbg[] PROGMEM = "Irradiance: ";
 
+static uint16_t s_irradianceReading; // ADC reading from the last update
+
 /*
  * Private Functions
  */
@@ -45,40 +48,53 @@ const char s_pstr_irradiance_dbg[] PROGMEM = "Irradiance: ";
  *	4. Set true if thermistor is a pullup
  */
 
-static float reading_to_irridiance(uint16_t reading)
+static int32_t reading_to_irridiance(uint16_t reading)
 {
   //TODO; actual conversion!
-  float result = reading * 2.0f + 46.7f;
-  return result; 
+  // Irradiance = reading * 2.0 + 46.7, in hundredths
+  return ((int32_t)reading * 200) + 4670;
 }
 
 /*
  * Public Functions
  */
 
-void IRR_WriteIrradianceToBuffer(FixedLengthAccumulator * accum)
+void IRR_UpdateIrradiance(void)
+{
+  s_irradianceReading = analogRead(IRRADIANCE_PIN);
+}
+
+uint16_t IRR_GetReading(void)
+{
+  return s_irradianceReading;
+}
+
+/*
+ * IRR_WriteIrradianceToBuffer
+ * Converts an ADC reading (from IRR_GetReading) to irradiance and writes it to the accumulator
+ */
+void IRR_WriteIrradianceToBuffer(uint16_t reading, FixedLengthAccumulator * accum)
 {
   if (!accum) { return; }
   
-  uint16_t reading = analogRead(IRRADIANCE_PIN);
-  float irr = reading_to_irridiance(reading);
-  
-  char buffer[10];
-  dtostrf(irr, 2, 2, buffer);  // Convert the irradiance value (double) into a string
-
-  accum->writeString(buffer);
+  uint16_t start = accum->length();
+  accum->writeFixed(reading_to_irridiance(reading), 2);
 
   if(APP_InDebugMode())
   {
-    Serial.print(PStringToRAM(s_pstr_irradiance_dbg));
-    Serial.println(buffer);  
+    Serial.print(FLASH_STRING(s_pstr_irradiance_dbg));
+    Serial.println(accum->c_str() + start);
   }
 }
 
 #else
 
-void IRR_WriteIrradianceToBuffer(FixedLengthAccumulator * accum)
+void IRR_UpdateIrradiance(void) {}
+uint16_t IRR_GetReading(void) { return 0; }
+
+void IRR_WriteIrradianceToBuffer(uint16_t reading, FixedLengthAccumulator * accum)
 {
+	(void)reading;
 	(void)accum;
 }
 
@@ -1,12 +1,16 @@
 #ifndef _IRRADIANCE_H_
 #define _IRRADIANCE_H_
 
+// Record fields (see fields.h)
 #if READ_IRRADIANCE == 1
-#define IRRADIANCE_HEADERS "Irradiance Wm-2, "
+#define IRRADIANCE_FIELDS(FIELD) \
+  FIELD(BINARY_FIELD_IRRADIANCE, "Irradiance Wm-2", 2, IRR_UpdateIrradiance, IRR_GetReading(), IRR_WriteIrradianceToBuffer)
 #else
-#define IRRADIANCE_HEADERS ""
+#define IRRADIANCE_FIELDS(FIELD)
 #endif
 
-void IRR_WriteIrradianceToBuffer(FixedLengthAccumulator * accum);
+void IRR_UpdateIrradiance(void);
+uint16_t IRR_GetReading(void);
+void IRR_WriteIrradianceToBuffer(uint16_t reading, FixedLengthAccumulator * accum);
 
 #endif
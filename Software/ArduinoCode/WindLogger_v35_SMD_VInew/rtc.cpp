@@ -16,6 +16,7 @@
 #include "rtc.h"
 #include "utility.h"
 #include "sd.h"
+#include "wind.h"
 
 /************ Real Time Clock code*******************
  * A PCF8563 RTC is attached to pins:
@@ -40,6 +41,7 @@
 
 static Rtc_Pcf8563 s_rtc;
 static int s_interrupt_pin;
+static volatile bool s_ticked = false; // Set by the interrupt, cleared by RTC_ClearTick
 
 /* 
  * Private Functions
@@ -58,8 +60,11 @@ static int s_interrupt_pin;
  ***************************************************/
 static void rtcInterruptHandler()
 { 
-  disableInterrupt(s_interrupt_pin);
+  // The interrupt stays enabled, so a main loop pass longer than a second still gets a tick for
+  // every second (the wind statistics latch each one on its own rather than merging them)
+  s_ticked = true;
 
+  WIND_SecondTick();
   SD_SecondTick();
   APP_SecondTick();
 }
@@ -128,7 +133,17 @@ void RTC_Setup(int scl, int sda, int interrupt_pin)
  */
 void RTC_EnableInterrupt()
 {
-	 enableInterrupt(s_interrupt_pin, rtcInterruptHandler, RISING);
+	s_ticked = false;
+	enableInterrupt(s_interrupt_pin, rtcInterruptHandler, RISING);
+}
+
+/* 
+ * RTC_ClearTick
+ * Forgets any tick so far, so that RTC_HasTicked shows the next one
+ */
+void RTC_ClearTick()
+{
+	s_ticked = false;
 }
 
 void RTC_DisableInterrupt()
@@ -136,6 +151,15 @@ void RTC_DisableInterrupt()
 	disableInterrupt(s_interrupt_pin);	
 }
 
+/* 
+ * RTC_HasTicked
+ * Returns true if the RTC interrupt has run since it was enabled or RTC_ClearTick was called
+ */
+bool RTC_HasTicked()
+{
+	return s_ticked;
+}
+
 /* 
  * RTC_GetDate
  * Updates the date string (in specified format) and returns a pointer to it
@@ -154,27 +178,6 @@ const char * RTC_GetTime()
 	return s_rtc.formatTime();
 }
 
-/*
- * RTC_GetYYMMDDString
- * Updates the local RTC date and fills the provided buffer with
- * the date in YYMMDD format.
- */
-void RTC_GetYYMMDDString(char * buffer)
-{
-  s_rtc.getDate(); // Update local RTC date
-  
-  int day_int = s_rtc.getDay();  // Get the actual day from the RTC
-  int month_int = s_rtc.getMonth();  // Get the month
-  int year_int = s_rtc.getYear();
-  
-  buffer[0]=(year_int/10) + '0';  // Convert from int to ascii
-  buffer[1]=(year_int%10) + '0';  // Convert from int to ascii 
-  buffer[2]= (month_int/10) + '0';  // Convert from int to ascii
-  buffer[3]= (month_int%10) + '0';  // Convert from int to ascii   
-  buffer[4]= (day_int/10) + '0';  // Convert from int to ascii
-  buffer[5]= (day_int%10) + '0';  // Convert from int to ascii 
-}
-
 /*
  * RTC_SetTime, RTC_SetDate
  * Sets the RTC time/date
@@ -22,6 +22,15 @@
 #include "temperature.h"
 #include "irradiance.h"
 #include "rtc.h"
+#include "eeprom_storage.h"
+#include "binary_record.h"
+#include "delta_record.h"
+#include "backfill.h"
+#include "sd_stats.h"
+#include "file_rotation.h"
+#include "daily_summary.h"
+#include "card_space.h"
+#include "fields.h"
 #include "sd.h"
 
 /*
@@ -31,120 +40,2128 @@
 #define SD_CHIP_SELECT_PIN 10 // The SD card Chip Select pin 10
 #define SD_CARD_DETECT_PIN 9  // The SD card detect is on pin 6
 
-#define DATA_STRING_LENGTH 128
+// Room for the longest CSV line, with the wind statistics, period and vector direction columns if they are compiled in
+#define DATA_STRING_LENGTH (128 + ((READ_WIND_STATISTICS == 1) ? 64 : 0) + ((READ_WIND_PERIODS == 1) ? 64 : 0) + ((WIND_VECTOR_DIRECTION == 1) ? 32 : 0))
+
+#define SD_SECTOR_SIZE 512
+
+#if SD_BINARY_FORMAT == 1
+#define SD_FILE_EXTENSION "bin"
+#if SD_DELTA_ENCODING == 1
+#define SD_BINARY_MAGIC BINARY_DELTA_MAGIC
+#else
+#define SD_BINARY_MAGIC BINARY_HEADER_MAGIC
+#endif
+#else
+#define SD_FILE_EXTENSION "csv"
+#endif
+
+#define SD_RAW_EXTENSION "raw"
+#define SD_RAW_FIELDS (BINARY_FIELD_WINDSPEED | BINARY_FIELD_WIND_DIRECTION)
+
+#if (SD_WRITE_BEHIND == 1) && (SD_KEEP_FILE_OPEN == 0)
+#error "SD_WRITE_BEHIND requires SD_KEEP_FILE_OPEN"
+#endif
+
+#if (SD_LOW_LATENCY == 1) && (SD_WRITE_BEHIND == 0)
+#error "SD_LOW_LATENCY requires SD_WRITE_BEHIND"
+#endif
+
+#if (SD_DELTA_ENCODING == 1) && (SD_BINARY_FORMAT == 0)
+#error "SD_DELTA_ENCODING requires SD_BINARY_FORMAT"
+#endif
+
+#if (SD_POWER_GATING == 1) && (SD_WRITE_BEHIND == 0)
+#error "SD_POWER_GATING requires SD_WRITE_BEHIND"
+#endif
+
+#if (READ_WINDSPEED == 1) && (READ_WIND_STATISTICS == 1) && (SD_BINARY_FORMAT == 1)
+#error "READ_WIND_STATISTICS is only written to CSV files (binary records have no room for it)"
+#endif
+
+#if (READ_WINDSPEED == 1) && (READ_WIND_PERIODS == 1) && (SD_BINARY_FORMAT == 1)
+#error "READ_WIND_PERIODS is only written to CSV files (binary records have no room for it)"
+#endif
+
+#if (READ_WIND_DIRECTION == 1) && (WIND_VECTOR_DIRECTION == 1) && (SD_BINARY_FORMAT == 1)
+#error "WIND_VECTOR_DIRECTION is only written to CSV files (binary records have no room for it)"
+#endif
+
+#if (READ_WINDSPEED == 1) && (WIND_DEBOUNCE == 1) && (SD_BINARY_FORMAT == 1)
+#error "WIND_DEBOUNCE is only written to CSV files (binary records have no room for the Rejected columns)"
+#endif
+
+// The fields from the field table that can be chosen by the field mask
+#define SD_TABLE_FIELDS (0 SD_FIELDS(FIELD_FLAG))
+
+// Recorded until a field mask is set over serial
+#define SD_DEFAULT_FIELD_MASK (BINARY_FIELD_WINDSPEED | BINARY_FIELD_WIND_DIRECTION | BINARY_FIELD_IRRADIANCE)
+
+// All the fields compiled in. Records kept in RAM and EEPROM always have all of them,
+// and only the fields in the current file are written to the card.
+#define SD_BINARY_FIELDS ( \
+  SD_TABLE_FIELDS | \
+  ((SD_STORE_AND_FORWARD == 1) ? BINARY_FIELD_BACKFILLED : 0) | \
+  ((SD_RECORD_CHECKS == 1) ? BINARY_FIELD_CHECKED : 0) )
+
+// Marker, timestamp, the readings from the field table and the sequence number and CRC.
+// Records kept in RAM and EEPROM have this layout even when writing CSV files.
+#define SD_RECORD_SIZE (1 + 4 SD_FIELDS(FIELD_WIDTH) + ((SD_RECORD_CHECKS == 1) ? 6 : 0))
+static_assert((SD_BINARY_FORMAT == 0) || (SD_RECORD_SIZE <= BINARY_MAX_RECORD_SIZE), "Too many fields for a binary record");
+static_assert((SD_STORE_AND_FORWARD == 0) || (SD_RECORD_SIZE <= BACKFILL_RAM_BYTES), "Too many fields for SD_STORE_AND_FORWARD (raise BACKFILL_RAM_BYTES)");
+
+#if SD_RECORD_CHECKS == 1
+#define RECORD_CHECK_HEADERS ", Seq, CRC"
+#else
+#define RECORD_CHECK_HEADERS ""
+#endif
+
+#define SD_CSV_FIXED_COLUMNS 3 // Ref, Date and Time come before the fields
+
+#define SD_CARD_DEBOUNCE_SECONDS 2 // Seconds the card detect must show a card before it is initialised
+#define SD_CARD_RETRY_SECONDS 30 // Seconds between attempts to initialise a card that failed
+
+#define SD_SEQUENCE_RESERVE_BLOCK 1024UL // Sequence numbers reserved per EEPROM write
+
+#define SD_SPI_NOT_PROBED 0 // No SPI clock divisor has been found for the card yet
+#define SD_SCRATCH_FILENAME "SPIPROBE.TMP" // Holds the block used to check each SPI clock
+
+#define SD_MAX_DAYS_DELETED 4 // Most days of files deleted each time the free space is checked
+
+#define SD_ERASE_CHUNK_BLOCKS 262144UL // Maximum blocks to erase per erase command (as per SdFat LowLatencyLogger)
+
+#define SD_POWER_PIN 7 // Switches the SD card supply when SD_POWER_GATING is 1 (D7 is free if there is no GSM module)
+#define SD_POWER_ON HIGH // Level on SD_POWER_PIN that powers the card
+#define SD_POWER_UP_MS 5 // Time for the card supply to settle before the card is started
+#define SD_CARD_ACTIVE_MA 40 // Typical card current while powered, used for the energy estimate
+#define SD_CARD_SUPPLY_MV 3300
+
+/*
+ * Private Variables
+ */
+
+static volatile long s_dataCounter = 0;  // This holds the number of seconds since the last data store
+static long s_sampleTime = 2;  // This is the time between samples for the DAQ
+
+static volatile bool s_writePending = false;  // A flag to tell the code when to write data
+
+// The other SD card pins (D11,D12,D13) are all set within s_SD.h
+// Card state is changed by the card detect (from the tick interrupt) and by SD_ServiceCard
+static volatile uint8_t s_cardState = SD_CARD_REMOVED;
+static uint8_t s_cardDetectSeconds = 0; // Seconds the card detect has shown a card (up to SD_CARD_DEBOUNCE_SECONDS)
+static uint8_t s_cardRetrySeconds = 0; // Seconds since a card failed to initialise
+static uint8_t s_spiDivisor = SD_SPI_NOT_PROBED; // SPI clock divisor for the card (cached in EEPROM)
+static uint32_t s_recordDay = 0; // Date (timestamp with the time cleared) of the latest record
+static uint32_t s_spaceDay = 0; // s_recordDay when the free space was last counted (0 to count it again)
+
+// SD file system object and file
+static SdFat s_sd;
+static SdFile s_datafile;  
+
+static char s_dataString[DATA_STRING_LENGTH];
+static FixedLengthAccumulator s_accumulator = FixedLengthAccumulator(NULL, 0);
+static char s_record[SD_RECORD_SIZE]; // The latest record (in binary_record.h format)
+
+#if SD_RECORD_CHECKS == 1
+static uint32_t s_sequence = 0; // Sequence number for the next record
+static uint32_t s_sequenceReserved = 0; // Sequence numbers below this have been reserved in EEPROM
+#endif
+
+static char s_filename[13];  // This is a holder for the full (8.3) file name
+static uint32_t s_filePeriod = ROTATION_NO_PERIOD; // Period (see file_rotation.cpp) of the current file
+static uint8_t s_filePart = 0; // Part of the period in ROTATION_SIZE mode
+static uint32_t s_fileBytes = 0; // Length of the data in the current file (including any still queued)
+static uint32_t s_nextPeriod = ROTATION_NO_PERIOD; // Next file to create while idle, before it is needed
+static uint8_t s_nextPart = 0;
+static char s_deviceID[3]; // A buffer to hold the device ID
+
+static uint8_t s_fields = SD_BINARY_FIELDS; // Fields for new files (from the field mask)
+static uint8_t s_fileFields = SD_BINARY_FIELDS; // Fields in the current file
+static bool s_fieldsChanged = false; // True if the field mask has changed since the current file was opened
+
+#if SD_BINARY_FORMAT == 0
+static char comma = ',';
+#if SD_RECORD_CHECKS == 1
+static const char s_hexDigits[] = "0123456789ABCDEF";
+#endif
+#endif
+
+static unsigned long s_writeCount = 0; // Number of records written to the card
+static unsigned long s_encodeCount = 0; // Number of records encoded
+static unsigned long s_encodeMicros = 0; // Total time spent encoding records
+
+#if SD_KEEP_FILE_OPEN == 1
+static uint16_t s_syncRecords = SD_DEFAULT_SYNC_RECORDS; // Records to write between syncs
+static uint16_t s_recordsSinceSync = 0;
+static volatile uint8_t s_secondsSinceSync = 0; // Single byte so the tick ISR update is atomic
+#endif
+
+#if SD_WRITE_BEHIND == 1
+static char s_queue[SD_SECTOR_SIZE]; // Records waiting to be written to the card
+static uint16_t s_queueUsed = 0;
+static uint16_t s_queueLimit = SD_SECTOR_SIZE; // Queue fills to the next sector boundary in the file
+static uint16_t s_queuedRecords = 0;
+#endif
+
+#if SD_LOW_LATENCY == 1
+static bool s_rawMode = false; // True if the current file is pre-allocated and written with raw block writes
+static bool s_streaming = false; // True while the card is in a multi-block write
+static uint32_t s_firstBlock = 0; // First card block of the current file
+static uint32_t s_blockCount = 0; // Number of pre-allocated blocks in the current file
+static uint32_t s_rawBlock = 0; // Block (relative to s_firstBlock) that the queue will be written to
+static uint16_t s_rawCounted = 0; // Bytes of the queue already taken off the free space (the block is re-written)
+#endif
+
+#if SD_POWER_GATING == 1
+static bool s_cardPowered = false;
+static unsigned long s_powerOnMillis = 0; // millis() when the card was last powered up
+static unsigned long s_cardOnMillis = 0; // Total time the card has been powered (not counting the current power-up)
+#endif
+
+#if SD_RAW_STREAM == 1
+static SdFile s_rawFile; // Raw stream file for the current data file
+static struct binary_raw_chunk s_rawChunk; // Seconds waiting to be written to the raw file
+static uint8_t s_rawChunkLimit = BINARY_RAW_SECONDS; // Seconds in the current chunk (fewer if the file changes sooner)
+static volatile uint8_t s_rawTicks = 0; // Incremented by the tick interrupt
+static uint8_t s_rawLastTick = 0; // s_rawTicks at the last second added to the chunk
+#endif
+
+// These are Char Strings - they are stored in program memory to save space in data memory
+// These are a mixutre of error messages and serial printed information
+// The field headers come from the field table (fields.h), in the same order as the fields are written.
+// Files only have the columns for the fields in the field mask (see buildCsvHeader).
+const char s_pstr_headers[] PROGMEM = \
+  "Ref, Date, Time" \
+  SD_FIELDS(FIELD_HEADER) \
+  BACKFILL_HEADERS \
+  RECORD_CHECK_HEADERS;
+static_assert(sizeof(s_pstr_headers) + 2 <= DATA_STRING_LENGTH, "Too many fields for the CSV header line");
+
+static const uint8_t s_fieldFlags[] PROGMEM = { SD_FIELDS(FIELD_FLAG_LIST) };
+
+const char s_pstr_initialised[] PROGMEM = "Init SD OK. Headers:";
+const char s_pstr_not_initialised[] PROGMEM = "Init SD Failed";
+const char s_pstr_noSD[] PROGMEM = "No SD card";
+const char s_pstrerroropen[] PROGMEM = "Error open";
+const char s_pstr_file_already_exists[] PROGMEM = "File already exists";
+const char s_pstr_writes[] PROGMEM = "Writes:";
+const char s_pstr_syncs[] PROGMEM = "Syncs:";
+const char s_pstr_pending[] PROGMEM = "Pending:";
+const char s_pstr_encode[] PROGMEM = "Encode us:";
+const char s_pstr_stored[] PROGMEM = "Stored:";
+const char s_pstr_lost[] PROGMEM = "Lost:";
+const char s_pstr_card[] PROGMEM = "Card:";
+const char s_pstr_spi[] PROGMEM = "SPI div:";
+const char s_pstr_deleted[] PROGMEM = "Deleted ";
+const char s_pstr_space_low[] PROGMEM = "SD card space low";
+const char s_pstr_fields[] PROGMEM = "Fields:";
+#if SD_POWER_GATING == 1
+const char s_pstr_card_on[] PROGMEM = "Card on ms:";
+const char s_pstr_energy[] PROGMEM = "Card uJ/rec:";
+#endif
+#if SD_RECORD_CHECKS == 1
+const char s_pstr_truncated[] PROGMEM = "Torn record removed";
+#endif
+
+/*
+ * Private Functions
+ */
+
+/*
+ * countBytesWritten
+ * Adds bytes written to the card to the statistics and takes them off the free space
+ */
+static void countBytesWritten(uint16_t bytes)
+{
+  SDSTATS_AddBytesWritten(bytes);
+  SPACE_AddBytesWritten(bytes);
+}
+
+#if SD_LOW_LATENCY == 1
+/*
+ * countRawBlockWritten
+ * Adds a raw block write to the statistics. Only the data added to the block since it was
+ * last written is taken off the free space.
+ */
+static void countRawBlockWritten()
+{
+  SDSTATS_AddBytesWritten(SD_SECTOR_SIZE);
+  if (s_queueUsed > s_rawCounted) { SPACE_AddBytesWritten(s_queueUsed - s_rawCounted); }
+  s_rawCounted = s_queueUsed;
+}
+#endif
+
+/*
+ * headerColumnLength
+ * Returns the length of the column header (including the ", " before it) that starts at column in s_pstr_headers
+ */
+static uint8_t headerColumnLength(const char * column)
+{
+  uint8_t length = 1;
+  char c;
+  while (((c = pgm_read_byte(&column[length])) != ',') && (c != '\0')) { length++; }
+  return length;
+}
+
+/*
+ * columnIsInFields
+ * Returns true if a column of s_pstr_headers (numbered from 0) is written for the given fields
+ */
+static bool columnIsInFields(uint8_t column, uint8_t fields)
+{
+  if ((column < SD_CSV_FIXED_COLUMNS) || (column >= (SD_CSV_FIXED_COLUMNS + sizeof(s_fieldFlags)))) { return true; }
+  return FIELD_IS_IN(fields, pgm_read_byte(&s_fieldFlags[column - SD_CSV_FIXED_COLUMNS]));
+}
+
+/*
+ * buildCsvHeader
+ * Fills the buffer with the CSV column headers for the given fields (without a line end) and returns its length
+ */
+static uint16_t buildCsvHeader(char * buffer, uint8_t fields)
+{
+  const char * column = s_pstr_headers;
+  uint16_t length = 0;
+
+  for (uint8_t i = 0; pgm_read_byte(column); i++)
+  {
+    uint8_t column_length = headerColumnLength(column);
+    if (columnIsInFields(i, fields))
+    {
+      memcpy_P(&buffer[length], column, column_length);
+      length += column_length;
+    }
+    column += column_length;
+  }
+  return length;
+}
+
+#if SD_BINARY_FORMAT == 0
+/*
+ * csvHeaderFields
+ * Works out which fields a CSV file has from its (terminated) header line.
+ * Returns false if the line does not have the columns this logger writes.
+ */
+static bool csvHeaderFields(const char * line, uint8_t * fields)
+{
+  const char * column = s_pstr_headers;
+  *fields = SD_BINARY_FIELDS & ~SD_TABLE_FIELDS;
+
+  for (uint8_t i = 0; pgm_read_byte(column); i++)
+  {
+    uint8_t column_length = headerColumnLength(column);
+    bool found = (strncmp_P(line, column, column_length) == 0) &&
+      ((line[column_length] == ',') || (line[column_length] == '\r'));
+
+    if (found)
+    {
+      line += column_length;
+      if (!columnIsInFields(i, 0)) { *fields |= pgm_read_byte(&s_fieldFlags[i - SD_CSV_FIXED_COLUMNS]); }
+    }
+    else if (columnIsInFields(i, 0))
+    {
+      // Columns that are always written must be there
+      return false;
+    }
+    column += column_length;
+  }
+  return (*line == '\r');
+}
+#endif
+
+/*
+ * changeCardState
+ * Moves the card from one state to another, unless the card detect changed the state first
+ */
+static bool changeCardState(uint8_t from, uint8_t to)
+{
+  bool changed = false;
+  noInterrupts();
+  if (s_cardState == from)
+  {
+    s_cardState = to;
+    changed = true;
+  }
+  interrupts();
+  return changed;
+}
+
+/*
+ * updateCardDetect
+ * Debounces the card detect pin (called every second from the tick interrupt).
+ * A removed card is seen straight away, but a card must be in for SD_CARD_DEBOUNCE_SECONDS
+ * before it is initialised.
+ */
+static void updateCardDetect()
+{
+  if (digitalRead(SD_CARD_DETECT_PIN) != LOW)
+  {
+    s_cardDetectSeconds = 0;
+    s_cardState = SD_CARD_REMOVED;
+    return;
+  }
+
+  if (s_cardDetectSeconds < SD_CARD_DEBOUNCE_SECONDS)
+  {
+    s_cardDetectSeconds++;
+    return;
+  }
+
+  if (s_cardState == SD_CARD_REMOVED)
+  {
+    s_cardState = SD_CARD_INSERTED;
+  }
+  else if ((s_cardState == SD_CARD_FAILED) && (++s_cardRetrySeconds >= SD_CARD_RETRY_SECONDS))
+  {
+    s_cardState = SD_CARD_INSERTED;
+  }
+}
+
+/*
+ * scratchBlockIsGood
+ * Writes a pattern to a block in a scratch file and checks that it reads back the same.
+ * The SdFat cache is used as the block buffer.
+ */
+static bool scratchBlockIsGood()
+{
+  SdFile file;
+  uint32_t block;
+  uint32_t last;
+  bool good = false;
+
+  s_sd.remove(SD_SCRATCH_FILENAME);
+  if (!file.createContiguous(s_sd.vwd(), SD_SCRATCH_FILENAME, SD_SECTOR_SIZE)) { return false; }
+  bool allocated = file.contiguousRange(&block, &last);
+  file.close();
+
+  if (allocated)
+  {
+    uint8_t * buffer = s_sd.vol()->cacheClear()->data;
+    for (uint16_t i = 0; i < SD_SECTOR_SIZE; i++) { buffer[i] = (uint8_t)((i * 13) ^ 0xA5); }
+
+    if (s_sd.card()->writeBlock(block, buffer))
+    {
+      memset(buffer, 0, SD_SECTOR_SIZE);
+      good = s_sd.card()->readBlock(block, buffer);
+      for (uint16_t i = 0; good && (i < SD_SECTOR_SIZE); i++)
+      {
+        good = (buffer[i] == (uint8_t)((i * 13) ^ 0xA5));
+      }
+    }
+  }
+
+  s_sd.remove(SD_SCRATCH_FILENAME);
+  return good;
+}
+
+/*
+ * beginAtFastestClock
+ * Starts the card at the fastest SPI clock that works, from the divisor given down to SPI_QUARTER_SPEED.
+ * If verify is true, each clock must also pass a write/read check. Returns the divisor used, or 0 if none worked.
+ */
+static uint8_t beginAtFastestClock(uint8_t divisor, bool verify)
+{
+  for (; divisor <= SPI_QUARTER_SPEED; divisor *= 2)
+  {
+    if (s_sd.begin(SD_CHIP_SELECT_PIN, divisor) && (!verify || scratchBlockIsGood()))
+    {
+      return divisor;
+    }
+  }
+  return 0;
+}
+
+/*
+ * cardError
+ * Called when a write to the card fails. The SPI clock is slowed down (if it can be)
+ * and the card is initialised again after the sample. Records are stored until then.
+ */
+static void cardError()
+{
+  if (!changeCardState(SD_CARD_READY, SD_CARD_INSERTED)) { return; }
+
+  if ((s_spiDivisor != SD_SPI_NOT_PROBED) && (s_spiDivisor < SPI_QUARTER_SPEED))
+  {
+    s_spiDivisor *= 2;
+    EEPROM_SetSpiDivisor(s_spiDivisor);
+  }
+}
+
+#if SD_POWER_GATING == 1
+/*
+ * powerCardOn
+ * Switches on the card supply and waits for it to settle
+ */
+static void powerCardOn()
+{
+  s_powerOnMillis = millis();
+  digitalWrite(SD_POWER_PIN, SD_POWER_ON);
+  delay(SD_POWER_UP_MS);
+  s_cardPowered = true;
+}
+#endif
+
+/*
+ * powerUpCard
+ * Called before the card is used. If SD_POWER_GATING is 1 and the card is powered down, it is powered up
+ * and only the card itself is started again: the volume, directory and open file details are still
+ * in RAM, and they are still correct because everything was synced before the card was powered down.
+ * Returns false if the card could not be started.
+ */
+static bool powerUpCard()
+{
+#if SD_POWER_GATING == 1
+  if (s_cardPowered) { return true; }
+
+  powerCardOn();
+  if (!s_sd.cardBegin(SD_CHIP_SELECT_PIN, s_spiDivisor))
+  {
+    cardError();
+    return false;
+  }
+#endif
+  return true;
+}
+
+/*
+ * initialiseCard
+ * Starts the SD library on a newly inserted card
+ */
+static bool initialiseCard()
+{
+  SDSTATS_AddReinitialisation();
+
+  // The free space on the new card is counted once it is in use
+  s_spaceDay = 0;
+
+  // Forget any file left open from before the card was removed.
+  // Closing it would sync stale FAT data onto the (possibly different) new card.
+  s_datafile = SdFile();
+#if SD_RAW_STREAM == 1
+  s_rawFile = SdFile();
+#endif
+#if SD_LOW_LATENCY == 1
+  if (s_rawMode)
+  {
+    // The queue holds the partial block of the old pre-allocated file. It belongs at s_rawBlock
+    // of that file, so it must not be appended to the end of whatever file is opened next.
+    s_queueUsed = 0;
+    s_queuedRecords = 0;
+    s_rawCounted = 0;
+    DELTA_Reset();
+  }
+  s_rawMode = false;
+  s_streaming = false;
+#endif
+#if SD_POWER_GATING == 1
+  if (!s_cardPowered) { powerCardOn(); }
+#endif
+
+  // Boards with resistor level shifters may not work at SPI_FULL_SPEED, so the first time
+  // the clock is found by trying each speed in turn. After that the cached divisor is used
+  // (or a slower one if that no longer starts).
+  bool probe = (s_spiDivisor == SD_SPI_NOT_PROBED);
+  uint8_t divisor = beginAtFastestClock(probe ? SPI_FULL_SPEED : s_spiDivisor, probe);
+  if (!divisor) {
+    if(APP_InDebugMode())
+    {
+      Serial.println(FLASH_STRING(s_pstr_not_initialised));
+    }
+    return false;
+  }
+
+  if (divisor != s_spiDivisor)
+  {
+    s_spiDivisor = divisor;
+    EEPROM_SetSpiDivisor(divisor);
+  }
+
+  if(APP_InDebugMode())
+  {
+    Serial.print(FLASH_STRING(s_pstr_spi));
+    Serial.println(s_spiDivisor);
+    Serial.println(FLASH_STRING(s_pstr_initialised));
+    Serial.write(s_dataString, buildCsvHeader(s_dataString, s_fields));
+    Serial.println();
+  }
+  return true;
+}
+
+#if SD_BINARY_FORMAT == 0
+/*
+ * write_fields
+ * Writes the given fields from the readings in a binary record (as listed in fields.h) and
+ * returns a pointer to the value after the readings
+ */
+#define WRITE_FIELD(flag, header, width, update, reading, writer) \
+  if (FIELD_IS_IN(fields, flag)) \
+  { \
+    accum->writeChar(comma); \
+    writer(BINARY_GetLittleEndian(values, width), accum); \
+  } \
+  values += width;
+
+static const uint8_t * write_fields(const uint8_t * values, uint8_t fields, FixedLengthAccumulator * accum)
+{
+  SD_FIELDS(WRITE_FIELD)
+  return values;
+}
+
+static void write_two_digits(uint8_t value, FixedLengthAccumulator * accum)
+{
+  accum->writeChar('0' + (value / 10));
+  accum->writeChar('0' + (value % 10));
+}
+#endif
+
+/*
+ * syncDataFile
+ * Flushes the SdFat cache and updates the directory entry of the current file
+ */
+static void syncDataFile()
+{
+  if (s_datafile.isOpen())
+  {
+    unsigned long start = micros();
+    if (!s_datafile.sync()) { cardError(); }
+    SDSTATS_AddLatency(SDSTATS_SYNC, micros() - start);
+  }
+
+#if SD_KEEP_FILE_OPEN == 1
+  s_recordsSinceSync = 0;
+  s_secondsSinceSync = 0;
+#endif
+}
+
+/*
+ * closeDataFile
+ * Syncs and closes the current file (if open)
+ */
+static void closeDataFile()
+{
+  if (s_datafile.isOpen())
+  {
+    syncDataFile();
+
+    unsigned long start = micros();
+    s_datafile.close();
+    SDSTATS_AddLatency(SDSTATS_CLOSE, micros() - start);
+  }
+}
+
+/*
+ * openFile
+ * Opens the current file with the given flags
+ */
+static bool openFile(uint8_t flags)
+{
+  unsigned long start = micros();
+  bool success = s_datafile.open(s_filename, flags);
+  SDSTATS_AddLatency(SDSTATS_OPEN, micros() - start);
+
+  if (!success) { SDSTATS_AddOpenFailure(); }
+  return success;
+}
+
+/*
+ * readFileFields
+ * Reads the fields that the current file (which must exist) was started with from its header.
+ * Returns false if the header can't be read.
+ */
+static bool readFileFields(uint8_t * fields)
+{
+  SdFile file;
+  bool found = false;
+
+  if (!file.open(s_filename, O_READ)) { return false; }
+
+#if SD_BINARY_FORMAT == 1
+  struct binary_file_header header;
+  if ((file.read(&header, sizeof(header)) == (int)sizeof(header)) &&
+    (memcmp(header.magic, SD_BINARY_MAGIC, sizeof(header.magic)) == 0))
+  {
+    *fields = header.fields;
+    found = true;
+  }
+#else
+  int length = file.read(s_dataString, DATA_STRING_LENGTH - 1);
+  if (length > 0)
+  {
+    s_dataString[length] = '\0';
+    found = csvHeaderFields(s_dataString, fields);
+  }
+#endif
+
+  file.close();
+  return found;
+}
+
+#if SD_WRITE_BEHIND == 1
+/*
+ * alignQueue
+ * Sizes the queue so that the next commit ends on a sector boundary of the current file.
+ * Every full commit after that is then a single, whole-sector write.
+ */
+static void alignQueue()
+{
+  s_queueLimit = SD_SECTOR_SIZE;
+  if (s_datafile.isOpen())
+  {
+    s_queueLimit -= (uint16_t)(s_datafile.fileSize() % SD_SECTOR_SIZE);
+  }
+  if (s_queueLimit < s_queueUsed)
+  {
+    s_queueLimit = s_queueUsed;
+  }
+}
+
+#if SD_LOW_LATENCY == 1
+/*
+ * blockIsBlank
+ * Returns true if the queue holds erased data at index.
+ * CSV data never contains 0x00 or 0xFF, and binary sectors always start with a record or the header.
+ */
+static bool blockIsBlank(uint16_t index)
+{
+  uint8_t value = (uint8_t)s_queue[index];
+#if SD_BINARY_FORMAT == 1
+  return !BINARY_IsRecordMarker(value) && (value != (uint8_t)BINARY_HEADER_MAGIC[0]);
+#else
+  return (value == 0x00) || (value == 0xFF);
+#endif
+}
+
+/*
+ * dataLengthInBlock
+ * Returns the number of bytes of data in the block held in the queue
+ */
+static uint16_t dataLengthInBlock(bool first_block)
+{
+  uint16_t length = 0;
+#if SD_BINARY_FORMAT == 1
+  uint8_t record_size = BINARY_RecordSize(s_fileFields);
+  if (first_block) { length = sizeof(struct binary_file_header); }
+  while (length < SD_SECTOR_SIZE)
+  {
+    uint8_t value = (uint8_t)s_queue[length];
+    uint8_t next = 0;
+    if (BINARY_IsRecordMarker(value))
+    {
+      if ((length + record_size) <= SD_SECTOR_SIZE) { next = record_size; }
+    }
+#if SD_DELTA_ENCODING == 1
+    else if ((value != 0x00) && (value != 0xFF))
+    {
+      next = BINARY_DeltaRecordLength((const uint8_t*)&s_queue[length], SD_SECTOR_SIZE - length, s_fileFields);
+    }
+#endif
+    if (next == 0) { break; }
+    length += next;
+  }
+#else
+  (void)first_block;
+  while ((length < SD_SECTOR_SIZE) && !blockIsBlank(length)) { length++; }
+#endif
+  return length;
+}
+
+/*
+ * stopStream
+ * Ends any multi-block write, so that the card can be used for other commands
+ */
+static void stopStream()
+{
+  if (s_streaming)
+  {
+    s_sd.card()->writeStop();
+    s_streaming = false;
+  }
+}
+
+/*
+ * contiguousFileBlocks
+ * Returns the number of blocks needed to hold a full file (day or hour) of records at the current sample time
+ */
+static uint32_t contiguousFileBlocks()
+{
+  uint32_t sampleTime = (s_sampleTime > 0) ? (uint32_t)s_sampleTime : 1;
+  uint32_t records = (ROTATION_GetPeriodSeconds() / sampleTime) + 1;
+  uint32_t blocks = ((records * (DATA_STRING_LENGTH + 2)) / SD_SECTOR_SIZE) + 2;
+
+  // Size-limited files move on to the next part once they are full
+  uint32_t max_blocks = (ROTATION_GetMaxBytes() / SD_SECTOR_SIZE) + 2;
+  if ((max_blocks > 2) && (blocks > max_blocks)) { blocks = max_blocks; }
+  return blocks;
+}
+
+/*
+ * eraseBlocks
+ * Flash erases pre-allocated blocks so that unused blocks can be found again after a reset
+ */
+static bool eraseBlocks(uint32_t first, uint32_t last)
+{
+  while (first <= last)
+  {
+    uint32_t end = first + SD_ERASE_CHUNK_BLOCKS - 1;
+    if (end > last) { end = last; }
+    if (!s_sd.card()->erase(first, end)) { return false; }
+    first = end + 1;
+  }
+  return true;
+}
+
+/*
+ * findEndOfContiguousFile
+ * Binary searches the pre-allocated blocks for the end of the data and re-loads the last,
+ * partly filled block into the queue so that records can be appended to it.
+ */
+static bool findEndOfContiguousFile()
+{
+  uint32_t low = 0;
+  uint32_t high = s_blockCount;
+
+  while (low < high)
+  {
+    uint32_t mid = low + ((high - low) / 2);
+    if (!s_sd.card()->readBlock(s_firstBlock + mid, (uint8_t*)s_queue)) { return false; }
+
+    if (blockIsBlank(0)) { high = mid; } else { low = mid + 1; }
+  }
+
+  s_queueUsed = 0;
+  s_rawBlock = low;
+
+  if (low == s_blockCount) { return false; } // No space left in this file
+
+  if (low > 0)
+  {
+    // Re-load the last block with data in it, and carry on writing into it
+    s_rawBlock = low - 1;
+    if (!s_sd.card()->readBlock(s_firstBlock + s_rawBlock, (uint8_t*)s_queue)) { return false; }
+    s_queueUsed = dataLengthInBlock(s_rawBlock == 0);
+
+    if (s_queueUsed == SD_SECTOR_SIZE)
+    {
+      s_rawBlock++;
+      s_queueUsed = 0;
+    }
+  }
+
+  // The re-loaded data is already on the card
+  s_rawCounted = s_queueUsed;
+
+  return true;
+}
+
+/*
+ * openContiguousFile
+ * Creates (or re-opens) today's file as a pre-allocated contiguous extent.
+ * Returns false if the file cannot be written with raw block writes, in which case
+ * the caller should fall back to a normal append.
+ */
+static bool openContiguousFile(bool file_exists)
+{
+  uint32_t lastBlock;
+
+  if (file_exists)
+  {
+    if (!openFile(O_RDWR)) { return false; }
+  }
+  else
+  {
+    if (!s_datafile.createContiguous(s_sd.vwd(), s_filename, contiguousFileBlocks() * SD_SECTOR_SIZE))
+    {
+      return false;
+    }
+  }
+
+  // A file that has already been truncated at rollover can no longer be written raw
+  if (!s_datafile.contiguousRange(&s_firstBlock, &lastBlock) || (s_datafile.fileSize() % SD_SECTOR_SIZE))
+  {
+    s_datafile.close();
+    return false;
+  }
+  s_blockCount = lastBlock - s_firstBlock + 1;
+
+  if (!file_exists && !eraseBlocks(s_firstBlock, lastBlock))
+  {
+    // Unused blocks could hold stale data, so don't use this file
+    s_datafile.remove();
+    return false;
+  }
+
+  if (!findEndOfContiguousFile())
+  {
+    s_datafile.close();
+    return false;
+  }
+
+  s_queueLimit = SD_SECTOR_SIZE;
+  s_rawMode = true;
+  return true;
+}
+
+/*
+ * finishContiguousFile
+ * Writes any partial block and truncates the pre-allocated file to the length of the data.
+ * The file is left open, positioned at the end.
+ */
+static void finishContiguousFile()
+{
+  if (!s_rawMode) { return; }
+
+  stopStream();
+  if (s_queueUsed && SD_CardIsPresent())
+  {
+    memset(&s_queue[s_queueUsed], 0, SD_SECTOR_SIZE - s_queueUsed);
+    s_sd.card()->writeBlock(s_firstBlock + s_rawBlock, (uint8_t*)s_queue);
+    countRawBlockWritten();
+  }
+
+  s_datafile.truncate((s_rawBlock * SD_SECTOR_SIZE) + s_queueUsed);
+  s_datafile.seekEnd();
+
+  s_rawMode = false;
+  s_queueUsed = 0;
+  s_queuedRecords = 0;
+  s_rawCounted = 0;
+}
+
+/*
+ * commitRawQueue
+ * Streams the queue to the pre-allocated file.
+ * Full blocks are sent as part of a multi-block write. A partial block is written on its own
+ * and kept in the queue, so that it is re-written as more records arrive.
+ */
+static bool commitRawQueue()
+{
+  bool success;
+
+  if (s_queueUsed == SD_SECTOR_SIZE)
+  {
+    if (!s_streaming)
+    {
+      s_streaming = s_sd.card()->writeStart(s_firstBlock + s_rawBlock, s_blockCount - s_rawBlock);
+    }
+    success = s_streaming && s_sd.card()->writeData((uint8_t*)s_queue);
+    countRawBlockWritten();
+
+    s_rawBlock++;
+    s_queueUsed = 0;
+    s_rawCounted = 0;
+  }
+  else
+  {
+    stopStream();
+    memset(&s_queue[s_queueUsed], 0, SD_SECTOR_SIZE - s_queueUsed);
+    success = s_sd.card()->writeBlock(s_firstBlock + s_rawBlock, (uint8_t*)s_queue);
+    countRawBlockWritten();
+  }
+
+  s_writeCount++;
+  s_queuedRecords = 0;
+  s_secondsSinceSync = 0;
+
+  if (!success)
+  {
+    s_streaming = false;
+    cardError();
+    if (APP_InDebugMode())
+    {
+      Serial.println(FLASH_STRING(s_pstrerroropen));
+    }
+  }
+
+  // Fall back to normal appends if the pre-allocated space runs out
+  if (s_rawBlock >= s_blockCount)
+  {
+    finishContiguousFile();
+    alignQueue();
+  }
+
+  return success;
+}
+#endif
+
+/*
+ * commitQueue
+ * Writes all queued data to the end of the current file and syncs it.
+ * Returns false (and discards the queue) if the data could not be written.
+ */
+static bool commitQueue()
+{
+  bool success;
+
+  if (s_queueUsed == 0) { return true; }
+
+  // Keep the queue while the card is out; it is committed once the card returns
+  if (!SD_CardIsPresent()) { return false; }
+
+  // A card that won't power up again is treated like a failed write
+  bool powered = powerUpCard();
+
+#if SD_LOW_LATENCY == 1
+  if (powered && s_rawMode) { return commitRawQueue(); }
+#endif
+
+  success = powered && (s_datafile.isOpen() || openFile(O_RDWR | O_CREAT | O_AT_END));
+  if (success)
+  {
+    success = (s_datafile.write(s_queue, s_queueUsed) == (int)s_queueUsed);
+    if (!success) { cardError(); }
+    s_writeCount++;
+    countBytesWritten(s_queueUsed);
+  }
+
+  if (!success)
+  {
+    // The queued records are lost, so the next record cannot be a delta against them
+    DELTA_Reset();
+    if (APP_InDebugMode())
+    {
+      Serial.println(FLASH_STRING(s_pstrerroropen));
+    }
+  }
+
+  s_queueUsed = 0;
+  s_queuedRecords = 0;
+  if (powered) { syncDataFile(); }
+  alignQueue();
+
+  return success;
+}
+
+/*
+ * queueBytes
+ * Copies bytes into the queue, committing each time the queue reaches a sector boundary.
+ * Returns false if a full queue could not be committed. The bytes from this call are then
+ * taken back out of the queue (any queue kept for the card's return holds only whole records)
+ * and the caller must store or drop them.
+ */
+static bool queueBytes(const char * bytes, uint16_t length)
+{
+  uint16_t start = s_queueUsed;
+
+  while (length)
+  {
+    uint16_t count = s_queueLimit - s_queueUsed;
+    if (count > length) { count = length; }
+
+    memcpy(&s_queue[s_queueUsed], bytes, count);
+    s_queueUsed += count;
+    bytes += count;
+    length -= count;
+
+    if (s_queueUsed >= s_queueLimit)
+    {
+      if (!commitQueue())
+      {
+        // The queue is still full if it was kept for the card's return, so don't go round again
+        if (s_queueUsed > start) { s_queueUsed = start; }
+        DELTA_Reset();
+        return false;
+      }
+      start = 0;
+    }
+  }
+
+  return true;
+}
+
+#endif
+
+#if (SD_BINARY_FORMAT == 1) || (SD_RAW_STREAM == 1)
+/*
+ * buildBinaryHeader
+ * Fills the buffer with a binary_file_header and returns its length
+ */
+static uint16_t buildBinaryHeader(char * buffer, const char * magic, uint8_t fields, uint8_t record_size, uint32_t sample_time)
+{
+  struct binary_file_header header;
+  float b, t0, r0, balance;
+
+  memcpy(header.magic, magic, sizeof(header.magic));
+  header.version = BINARY_FORMAT_VERSION;
+  header.fields = fields;
+  header.record_size = record_size;
+  header.device_id[0] = s_deviceID[0];
+  header.device_id[1] = s_deviceID[1];
+  header.sample_time = sample_time;
+  header.r1 = EEPROM_GetR1();
+  header.r2 = EEPROM_GetR2();
+  header.current_offset = EEPROM_GetCurrentOffset();
+  header.current_gain = EEPROM_GetCurrentGain();
+
+  TEMP_GetThermistorConstants(&b, &t0, &r0, &balance);
+  header.thermistor_b = b;
+  header.thermistor_t0 = t0;
+  header.thermistor_r0 = r0;
+  header.thermistor_balance = balance;
+
+  memcpy(buffer, &header, sizeof(header));
+  return sizeof(header);
+}
+#endif
+
+/*
+ * buildFileHeader
+ * Fills the buffer with the header for a new file with the given fields and returns its length
+ */
+static uint16_t buildFileHeader(char * buffer, uint8_t fields)
+{
+#if SD_BINARY_FORMAT == 1
+  return buildBinaryHeader(buffer, SD_BINARY_MAGIC, fields, BINARY_RecordSize(fields), (uint32_t)s_sampleTime);
+#else
+  // Copied straight from flash into the write buffer
+  uint16_t length = buildCsvHeader(buffer, fields);
+  buffer[length++] = '\r';
+  buffer[length++] = '\n';
+  return length;
+#endif
+}
+
+/*
+ * putLittleEndian
+ * Writes the lowest count bytes of value to buffer (least significant first)
+ * and returns a pointer to the next byte
+ */
+static char * putLittleEndian(char * buffer, uint32_t value, uint8_t count)
+{
+  while (count--)
+  {
+    *buffer++ = (char)(value & 0xFF);
+    value >>= 8;
+  }
+  return buffer;
+}
+
+#if SD_RECORD_CHECKS == 1
+/*
+ * nextSequence
+ * Returns the sequence number for a new record.
+ * Numbers are reserved in EEPROM a block at a time, so they keep increasing
+ * across resets without writing the EEPROM for every record
+ * (a reset skips the rest of the reserved block).
+ */
+static uint32_t nextSequence()
+{
+  if (s_sequence == s_sequenceReserved)
+  {
+    if (s_sequenceReserved == 0)
+    {
+      // First record since reset: carry on from the last reserved block
+      s_sequence = EEPROM_GetSequenceReserved();
+      if (s_sequence == 0xFFFFFFFFUL) { s_sequence = 0; } // Blank EEPROM
+    }
+    s_sequenceReserved = s_sequence + SD_SEQUENCE_RESERVE_BLOCK;
+    EEPROM_SetSequenceReserved(s_sequenceReserved);
+  }
+  return s_sequence++;
+}
+
+#if SD_BINARY_FORMAT == 0
+/*
+ * csvLineIsValid
+ * Returns true if a line (including its "\r\n") ends with the correct CRC column
+ */
+static bool csvLineIsValid(const char * line, uint16_t length)
+{
+  // The line ends ",XXXX\r\n", and the CRC covers everything up to and including the comma
+  if ((length < 7) || (line[length - 2] != '\r') || (line[length - 7] != ',')) { return false; }
+
+  uint16_t crc = BINARY_Crc16(BINARY_CRC16_INIT, (const uint8_t*)line, length - 6);
+  for (uint8_t i = 0; i < 4; i++)
+  {
+    if (line[length - 6 + i] != s_hexDigits[(crc >> (12 - (4 * i))) & 0x0F]) { return false; }
+  }
+  return true;
+}
+
+/*
+ * findLineEnd
+ * Sets position to just after the last '\n' before end in the current file (0 if there isn't one).
+ * Returns false if the file can't be read.
+ */
+static bool findLineEnd(uint32_t end, uint32_t * position)
+{
+  while (end > 0)
+  {
+    uint16_t length = (end > (DATA_STRING_LENGTH - 1)) ? (DATA_STRING_LENGTH - 1) : (uint16_t)end;
+    end -= length;
+    s_datafile.seekSet(end);
+    if (s_datafile.read(s_dataString, length) != (int)length) { return false; }
+
+    while ((length > 0) && (s_dataString[length - 1] != '\n')) { length--; }
+    if (length > 0)
+    {
+      *position = end + length;
+      return true;
+    }
+  }
+  *position = 0;
+  return true;
+}
+#else
+
+/*
+ * binaryRecordIsValid
+ * Returns true if the CRC at the end of a record (keyframe or delta) is correct
+ */
+static bool binaryRecordIsValid(const char * record, uint16_t length)
+{
+  return BINARY_Crc16(BINARY_CRC16_INIT, (const uint8_t*)record, length - 2) ==
+    BINARY_GetLittleEndian((const uint8_t*)&record[length - 2], 2);
+}
+#endif
+
+/*
+ * recoverFileTail
+ * Checks the end of the (just opened) current file for a record torn by a power failure
+ * and truncates the file after the last good record. Returns the new file size.
+ */
+static uint32_t recoverFileTail()
+{
+  uint32_t size = s_datafile.fileSize();
+  uint32_t good;
+
+#if SD_BINARY_FORMAT == 1
+  const uint8_t record_size = BINARY_RecordSize(s_fileFields);
+#if SD_DELTA_ENCODING == 1
+  bool have_reference = false;
+#endif
+
+  if (size < sizeof(struct binary_file_header)) { return s_datafile.truncate(0) ? 0 : size; }
+
+  // Every sector starts with a full record, so the scan can start at the last sector
+  good = ((size - 1) / SD_SECTOR_SIZE) * SD_SECTOR_SIZE;
+  if (good < sizeof(struct binary_file_header)) { good = sizeof(struct binary_file_header); }
+
+  uint32_t position = good;
+  while (position < size)
+  {
+    uint16_t space = SD_SECTOR_SIZE - (uint16_t)(position % SD_SECTOR_SIZE);
+    uint16_t available = (size - position < space) ? (uint16_t)(size - position) : space;
+    if (available > BINARY_MAX_RECORD_SIZE) { available = BINARY_MAX_RECORD_SIZE; }
+
+    s_datafile.seekSet(position);
+    if (s_datafile.read(s_dataString, available) != (int)available) { break; }
+
+    uint8_t first = (uint8_t)s_dataString[0];
+    uint16_t length = 0;
+    if (BINARY_IsRecordMarker(first))
+    {
+      length = record_size;
+    }
+#if SD_DELTA_ENCODING == 1
+    else if (have_reference && (first != 0x00) && (first != 0xFF))
+    {
+      length = BINARY_DeltaRecordLength((const uint8_t*)s_dataString, available, s_fileFields);
+    }
+#endif
+    else if ((first == 0x00) && (space < SD_SECTOR_SIZE))
+    {
+      // Padding to the end of the sector
+      position += space;
+#if SD_DELTA_ENCODING == 1
+      have_reference = false;
+#endif
+      continue;
+    }
+
+    if ((length == 0) || (length > available) || !binaryRecordIsValid(s_dataString, length)) { break; }
+
+    position += length;
+    good = position;
+#if SD_DELTA_ENCODING == 1
+    have_reference = true;
+#endif
+  }
+#else
+  // Anything after the last line end is a torn line
+  if (!findLineEnd(size, &good)) { return size; }
+
+  uint32_t line = 0;
+  if ((good > 0) && !findLineEnd(good - 1, &line)) { return size; }
+
+  // The header (the only line that starts the file) has no CRC.
+  // A line too long for the buffer can't be a record, so it is torn too.
+  if ((good > 0) && (line > 0))
+  {
+    uint16_t length = ((good - line) < DATA_STRING_LENGTH) ? (uint16_t)(good - line) : DATA_STRING_LENGTH;
+    s_datafile.seekSet(line);
+    if ((length == DATA_STRING_LENGTH) || (s_datafile.read(s_dataString, length) != (int)length) ||
+      !csvLineIsValid(s_dataString, length))
+    {
+      good = line;
+    }
+  }
+#endif
+
+  if ((good < size) && s_datafile.truncate(good))
+  {
+    if(APP_InDebugMode())
+    {
+      Serial.println(FLASH_STRING(s_pstr_truncated));
+    }
+    size = good;
+  }
+  s_datafile.seekEnd();
+  return size;
+}
+#endif
+
+/*
+ * getTimestamp
+ * Returns the packed timestamp (see binary_record.h) for the date and time as given by
+ * RTC_GetDate(RTCC_DATE_WORLD) ("dd-mm-yyyy") and RTC_GetTime() ("hh:mm:ss")
+ */
+static uint32_t getTimestamp(const char * date, const char * time)
+{
+  return BINARY_PACK_TIMESTAMP(
+    ((date[8] - '0') * 10) + (date[9] - '0'),
+    ((date[3] - '0') * 10) + (date[4] - '0'),
+    ((date[0] - '0') * 10) + (date[1] - '0'),
+    ((time[0] - '0') * 10) + (time[1] - '0'),
+    ((time[3] - '0') * 10) + (time[4] - '0'),
+    ((time[6] - '0') * 10) + (time[7] - '0')
+  );
+}
+
+/*
+ * buildBinaryRecord
+ * Fills the buffer with a binary record (see binary_record.h) holding the readings from
+ * the field table and returns its length. It has all the fields compiled in, with 0 for
+ * any not in the given fields.
+ */
+#define PUT_FIELD(flag, header, width, update, reading, writer) \
+  p = putLittleEndian(p, FIELD_IS_IN(fields, flag) ? (reading) : 0, width);
+
+static uint16_t buildBinaryRecord(char * buffer, uint32_t timestamp, uint8_t fields)
+{
+  char * p = buffer;
+
+  *p++ = (char)BINARY_RECORD_MARKER;
+  p = putLittleEndian(p, timestamp, 4);
+
+  SD_FIELDS(PUT_FIELD)
+
+#if SD_RECORD_CHECKS == 1
+  // The CRC is filled in by encodeRecord
+  p = putLittleEndian(p, nextSequence(), 4);
+  p = putLittleEndian(p, 0, 2);
+#endif
+
+  return (uint16_t)(p - buffer);
+}
+
+/*
+ * encodeRecord
+ * Converts a binary record (from buildBinaryRecord) into the output format in s_dataString,
+ * with only the given fields, and returns its length
+ */
+#if SD_BINARY_FORMAT == 1
+#define PACK_FIELD(flag, header, width, update, reading, writer) \
+  if (FIELD_IS_IN(fields, flag)) \
+  { \
+    memcpy(p, values, width); \
+    p += width; \
+  } \
+  values += width;
+#endif
+
+static uint16_t encodeRecord(const char * record, uint8_t fields)
+{
+#if SD_BINARY_FORMAT == 1
+  const char * values = &record[5];
+  char * p = &s_dataString[5];
+
+  // Marker and timestamp, then the readings for the fields in the file
+  memcpy(s_dataString, record, 5);
+  SD_FIELDS(PACK_FIELD)
+#if SD_RECORD_CHECKS == 1
+  memcpy(p, values, 6);
+  p += 6;
+#endif
+
+  uint16_t length = (uint16_t)(p - s_dataString);
+#if SD_RECORD_CHECKS == 1
+  // The marker may have changed since the record was built, so the CRC is only worked out now
+  putLittleEndian(&s_dataString[length - 2], BINARY_Crc16(BINARY_CRC16_INIT, (const uint8_t*)s_dataString, length - 2), 2);
+#endif
+  return length;
+#else
+  uint32_t timestamp = BINARY_GetLittleEndian((const uint8_t*)&record[1], 4);
+
+  s_accumulator.reset();
+  s_accumulator.writeChar(s_deviceID[0]);
+  s_accumulator.writeChar(s_deviceID[1]);
+  s_accumulator.writeChar(comma);
+  write_two_digits(BINARY_TIMESTAMP_DAY(timestamp), &s_accumulator);
+  s_accumulator.writeChar('-');
+  write_two_digits(BINARY_TIMESTAMP_MONTH(timestamp), &s_accumulator);
+  s_accumulator.write("-20", 3);
+  write_two_digits(BINARY_TIMESTAMP_YEAR(timestamp), &s_accumulator);
+  s_accumulator.writeChar(comma);
+  write_two_digits(BINARY_TIMESTAMP_HOUR(timestamp), &s_accumulator);
+  s_accumulator.writeChar(':');
+  write_two_digits(BINARY_TIMESTAMP_MINUTE(timestamp), &s_accumulator);
+  s_accumulator.writeChar(':');
+  write_two_digits(BINARY_TIMESTAMP_SECOND(timestamp), &s_accumulator);
+
+  const uint8_t * values = write_fields((const uint8_t*)&record[5], fields, &s_accumulator);
+  (void)values; // Only needed for the record checks
+
+#if SD_STORE_AND_FORWARD == 1
+  s_accumulator.writeChar(comma);
+  s_accumulator.writeChar(((uint8_t)record[0] == BINARY_BACKFILL_MARKER) ? '1' : '0');
+#endif
+
+#if SD_RECORD_CHECKS == 1
+  s_accumulator.writeChar(comma);
+  s_accumulator.writeUnsigned(BINARY_GetLittleEndian(values, 4));
+  s_accumulator.writeChar(comma);
+
+  // CRC of everything before it on the line (including the comma), as four hex digits
+  uint16_t crc = BINARY_Crc16(BINARY_CRC16_INIT, (const uint8_t*)s_dataString, s_accumulator.length());
+  for (int8_t shift = 12; shift >= 0; shift -= 4)
+  {
+    s_accumulator.writeChar(s_hexDigits[(crc >> shift) & 0x0F]);
+  }
+#endif
+
+  s_accumulator.write("\r\n", 2);
+  return s_accumulator.length();
+#endif
+}
+
+/*
+ * printRecord
+ * Echoes the latest record to the serial port
+ */
+static void printRecord(uint16_t length)
+{
+#if SD_BINARY_FORMAT == 1
+  for (uint16_t i = 0; i < length; i++)
+  {
+    uint8_t value = (uint8_t)s_dataString[i];
+    if (value < 0x10) { Serial.print('0'); }
+    Serial.print(value, HEX);
+  }
+  Serial.println();
+#else
+  (void)length;
+  Serial.print(s_accumulator.c_str());
+#endif
+}
+
+#if SD_WRITE_BEHIND == 0
+/*
+ * openDataFile
+ * Opens the current file for writing at the end (if not already open)
+ */
+static bool openDataFile()
+{
+  return s_datafile.isOpen() || openFile(O_RDWR | O_CREAT | O_AT_END);
+}
+#endif
+
+#if SD_BINARY_FORMAT == 1
+/*
+ * sectorSpace
+ * Returns the number of bytes left before the next sector boundary of the current file
+ */
+static uint16_t sectorSpace()
+{
+#if SD_WRITE_BEHIND == 1
+  return s_queueLimit - s_queueUsed;
+#else
+  return SD_SECTOR_SIZE - (uint16_t)(s_datafile.fileSize() % SD_SECTOR_SIZE);
+#endif
+}
+#endif
+
+/*
+ * writeBytes
+ * Writes bytes to the end of the current file (or into the queue in write-behind mode).
+ * Returns false if they could not be written.
+ */
+static bool writeBytes(const char * bytes, uint16_t length)
+{
+#if SD_WRITE_BEHIND == 1
+  if (!queueBytes(bytes, length)) { return false; }
+#else
+  if (s_datafile.write(bytes, length) != (int)length)
+  {
+    cardError();
+    DELTA_Reset();
+    return false;
+  }
+  countBytesWritten(length);
+#endif
+  s_fileBytes += length;
+  return true;
+}
+
+/*
+ * writeRecord
+ * Writes a complete record to the current file.
+ * In write-behind mode, the record is queued and only written to the card
+ * when a sector is full or the flush deadline passes.
+ * Returns false if the record could not be written, so that the caller can store it.
+ */
+static bool writeRecord(const char * record, uint16_t length)
+{
+#if SD_WRITE_BEHIND == 0
+  if (!openDataFile())
+  {
+    DELTA_Reset();
+    if(APP_InDebugMode())
+    {
+      Serial.println(FLASH_STRING(s_pstrerroropen));
+    }
+    return false;
+  }
+#endif
+
+#if SD_BINARY_FORMAT == 1
+  // Binary records never straddle a sector, so that every sector can be decoded on its own
+  uint16_t space = sectorSpace();
+
+#if SD_DELTA_ENCODING == 1
+  // The first record in each sector is always a keyframe
+  char delta[BINARY_MAX_DELTA_SIZE];
+  uint8_t delta_length = 0;
+  if ((space < SD_SECTOR_SIZE) && ((uint8_t)record[0] == BINARY_RECORD_MARKER))
+  {
+    unsigned long start = micros();
+    delta_length = DELTA_Encode(record, s_fileFields, s_sampleTime, delta);
+    s_encodeMicros += micros() - start;
+  }
+
+  DELTA_SetReference(record, length);
+  if (delta_length && (delta_length <= space))
+  {
+    record = delta;
+    length = delta_length;
+  }
+#endif
+
+  if (length > space)
+  {
+    static const char padding[16] = {0};
+    while (space)
+    {
+      uint16_t count = (space > sizeof(padding)) ? sizeof(padding) : space;
+      if (!writeBytes(padding, count)) { return false; }
+      space -= count;
+    }
+  }
+#endif
+
+  if (!writeBytes(record, length)) { return false; }
+
+#if SD_WRITE_BEHIND == 1
+  // Record is pending if any of it is still in the queue
+  if (s_queueUsed) { s_queuedRecords++; }
+
+  if (s_secondsSinceSync >= SD_MAX_SECONDS_BETWEEN_SYNCS)
+  {
+    commitQueue();
+  }
+#elif SD_KEEP_FILE_OPEN == 1
+  s_writeCount++;
+  s_recordsSinceSync++;
+
+  // The data only reaches the card when the SdFat cache is synced
+  if ((s_recordsSinceSync >= s_syncRecords) || (s_secondsSinceSync >= SD_MAX_SECONDS_BETWEEN_SYNCS))
+  {
+    syncDataFile();
+  }
+#else
+  s_writeCount++;
+  closeDataFile();
+#endif
+
+  return true;
+}
+
+#if SD_RAW_STREAM == 1
+/*
+ * openRawFile
+ * Opens (or creates) the raw stream file that goes with the current data file.
+ * A chunk torn by a power failure is removed from the end of the file.
+ */
+static bool openRawFile()
+{
+  char filename[13];
+
+  ROTATION_GetFilename(filename, s_filePeriod, s_filePart, SD_RAW_EXTENSION);
+
+  unsigned long start = micros();
+  bool success = s_rawFile.open(filename, O_RDWR | O_CREAT | O_AT_END);
+  SDSTATS_AddLatency(SDSTATS_OPEN, micros() - start);
+
+  if (!success)
+  {
+    SDSTATS_AddOpenFailure();
+    return false;
+  }
+
+  uint32_t size = s_rawFile.fileSize();
+  if (size < sizeof(struct binary_file_header))
+  {
+    uint16_t length = buildBinaryHeader(s_dataString, BINARY_RAW_MAGIC, SD_RAW_FIELDS, sizeof(struct binary_raw_chunk), 1);
+    s_rawFile.truncate(0);
+    s_rawFile.write(s_dataString, length);
+    countBytesWritten(length);
+  }
+  else
+  {
+    uint32_t torn = (size - sizeof(struct binary_file_header)) % sizeof(struct binary_raw_chunk);
+    if (torn)
+    {
+      s_rawFile.truncate(size - torn);
+      s_rawFile.seekEnd();
+    }
+  }
+  return true;
+}
+
+/*
+ * closeRawFile
+ * Closes the raw stream file (if open)
+ */
+static void closeRawFile()
+{
+  if (s_rawFile.isOpen())
+  {
+    unsigned long start = micros();
+    s_rawFile.close();
+    SDSTATS_AddLatency(SDSTATS_CLOSE, micros() - start);
+  }
+}
+
+/*
+ * writeRawChunk
+ * Appends the seconds collected so far to the raw stream file for the current data file.
+ * They are dropped if there is no card (they are not stored like the records).
+ */
+static void writeRawChunk()
+{
+  if (s_rawChunk.count == 0) { return; }
+
+  if (SD_CardIsPresent() && (s_filePeriod != ROTATION_NO_PERIOD) && powerUpCard())
+  {
+#if SD_LOW_LATENCY == 1
+    stopStream();
+#endif
+    if (s_rawFile.isOpen() || openRawFile())
+    {
+      s_rawFile.write(&s_rawChunk, sizeof(s_rawChunk));
+      countBytesWritten(sizeof(s_rawChunk));
+
+      unsigned long start = micros();
+#if SD_KEEP_FILE_OPEN == 1
+      s_rawFile.sync();
+      SDSTATS_AddLatency(SDSTATS_SYNC, micros() - start);
+#else
+      s_rawFile.close();
+      SDSTATS_AddLatency(SDSTATS_CLOSE, micros() - start);
+#endif
+    }
+  }
+
+  s_rawChunk.count = 0;
+}
+#endif
+
+/*
+ * createFileForPeriod
+ * Finishes with the current file and opens the file for a period (and part),
+ * creating it if it doesn't exist.
+ */
+static void createFileForPeriod(uint32_t period, uint8_t part)
+{
+  // Check there is a file created with the date in the title
+  // If it does then create a new one with the new name
+  // The name is created by ROTATION_GetFilename, for example
+  // DYYMMDD.CSV, where YY is the year MM is the month, DD is the day
+
+  // Finish with the previous file before moving to the new one
+#if SD_RAW_STREAM == 1
+  writeRawChunk();
+  closeRawFile();
+#endif
+#if SD_LOW_LATENCY == 1
+  finishContiguousFile();
+#endif
+#if SD_WRITE_BEHIND == 1
+  commitQueue();
+#endif
+  closeDataFile();
+
+  // Each file starts with a keyframe
+  DELTA_Reset();
+
+  ROTATION_GetFilename(s_filename, period, part, SD_FILE_EXTENSION);
+  bool file_exists = s_sd.exists(s_filename);
+
+  // A file keeps the fields it was started with. If the field mask has changed since,
+  // the next part is started instead (hourly files have no parts, so they keep their fields).
+  uint8_t fields;
+  s_fileFields = s_fields;
+  s_fieldsChanged = false;
+  while (file_exists && readFileFields(&fields) && (fields != s_fileFields))
+  {
+    if ((ROTATION_GetMode() == ROTATION_HOURLY) || (part >= (ROTATION_MAX_PARTS - 1)))
+    {
+      s_fileFields = fields & SD_BINARY_FIELDS;
+      break;
+    }
+    ROTATION_GetFilename(s_filename, period, ++part, SD_FILE_EXTENSION);
+    file_exists = s_sd.exists(s_filename);
+  }
+
+  s_filePeriod = period;
+  s_filePart = part;
+  s_fileBytes = 0;
+
+	if(APP_InDebugMode())
+	{
+		Serial.println(s_filename);
+	}
+
+#if SD_LOW_LATENCY == 1
+  if (openContiguousFile(file_exists))
+  {
+    if ((s_rawBlock == 0) && (s_queueUsed == 0))
+    {
+      // New file: the headers go out with the first block
+      s_queueUsed = buildFileHeader(s_queue, s_fileFields);
+    }
+    s_fileBytes = (s_rawBlock * SD_SECTOR_SIZE) + s_queueUsed;
+    return;
+  }
+  file_exists = s_sd.exists(s_filename);
+#endif
+
+  // open the file for write at end like the Native SD library
+  if (!openFile(O_RDWR | O_CREAT | O_AT_END)) 
+  {
+    if(APP_InDebugMode())
+    {
+      Serial.println(FLASH_STRING(s_pstrerroropen));
+    }
+    return;
+  }
+
+#if SD_RECORD_CHECKS == 1
+  // A power failure may have left a torn record at the end of the file
+  if (file_exists && (recoverFileTail() == 0))
+  {
+    file_exists = false;
+  }
+#endif
+
+	if(!file_exists)
+	{
+    // if the file opened okay, write to it and sync:
+    uint16_t length = buildFileHeader(s_dataString, s_fileFields);
+    s_datafile.write(s_dataString, length);
+    countBytesWritten(length);
+	} 
+	else
+	{
+    if(APP_InDebugMode())
+    {
+      Serial.println(FLASH_STRING(s_pstr_file_already_exists));
+    }
+	}
+
+  s_fileBytes = s_datafile.fileSize();
+
+#if SD_KEEP_FILE_OPEN == 1
+  // Keep the file open for the rest of the day
+  syncDataFile();
+#if SD_WRITE_BEHIND == 1
+  alignQueue();
+#endif
+#else
+  closeDataFile();
+#endif
+}
+
+/*
+ * fileIsFull
+ * Returns true if the current file has reached the size limit (and another part can be started)
+ */
+static bool fileIsFull()
+{
+  uint32_t max_bytes = ROTATION_GetMaxBytes();
+  return max_bytes && (s_fileBytes >= max_bytes) && (s_filePart < (ROTATION_MAX_PARTS - 1));
+}
+
+/*
+ * lastPartForPeriod
+ * Returns the last part of a period that is already on the card
+ */
+static uint8_t lastPartForPeriod(uint32_t period)
+{
+  char filename[13];
+  uint8_t part = 0;
+
+  while (part < (ROTATION_MAX_PARTS - 1))
+  {
+    ROTATION_GetFilename(filename, period, part + 1, SD_FILE_EXTENSION);
+    if (!s_sd.exists(filename)) { break; }
+    part++;
+  }
+  return part;
+}
+
+/*
+ * openFileForPeriod
+ * Opens the file for a period: this is its last part (parts are started in ROTATION_SIZE mode
+ * and when the fields change), or the part after that if it is full
+ */
+static void openFileForPeriod(uint32_t period)
+{
+  uint8_t part = 0;
+
+  // Hourly file names have no part
+  if (ROTATION_GetMode() != ROTATION_HOURLY)
+  {
+    if (period != s_filePeriod)
+    {
+      part = lastPartForPeriod(period);
+    }
+    else
+    {
+      part = fileIsFull() ? (s_filePart + 1) : s_filePart;
+    }
+  }
+
+  createFileForPeriod(period, part);
+
+  if (fileIsFull())
+  {
+    // An existing part was already full
+    createFileForPeriod(period, part + 1);
+  }
+}
 
 /*
- * Private Variables
+ * planNextFile
+ * After a record is written, decides if the next record will need a new file,
+ * so that it can be created beforehand by createNextFile
  */
+static void planNextFile(uint32_t timestamp)
+{
+  if (ROTATION_GetSecondsToNextPeriod(timestamp) <= (uint32_t)s_sampleTime)
+  {
+    s_nextPeriod = ROTATION_GetNextPeriod(s_filePeriod);
+    s_nextPart = 0;
+  }
+  else if (fileIsFull())
+  {
+    s_nextPeriod = s_filePeriod;
+    s_nextPart = s_filePart + 1;
+  }
+}
 
-static long s_dataCounter = 0;  // This holds the number of seconds since the last data store
-static long s_sampleTime = 2;  // This is the time between samples for the DAQ
+/*
+ * createNextFile
+ * Creates the file planned by planNextFile (with its headers) while the logger is idle,
+ * so that the rollover itself only has to open it
+ */
+static void createNextFile()
+{
+  char filename[13];
+  SdFile file;
 
-static volatile bool s_writePending = false;  // A flag to tell the code when to write data
-static char s_last_used_date[16];
+  if (s_nextPeriod == ROTATION_NO_PERIOD) { return; }
 
-// The other SD card pins (D11,D12,D13) are all set within s_SD.h
-static int s_lastCardDetect = LOW;  // This is the flag for the old reading of the card detect
+  ROTATION_GetFilename(filename, s_nextPeriod, s_nextPart, SD_FILE_EXTENSION);
+  s_nextPeriod = ROTATION_NO_PERIOD;
 
-// SD file system object and file
-static SdFat s_sd;
-static SdFile s_datafile;  
+  if (!powerUpCard() || s_sd.exists(filename)) { return; }
 
-static char s_dataString[DATA_STRING_LENGTH];
-static FixedLengthAccumulator s_accumulator = FixedLengthAccumulator(NULL, 0);
+#if SD_LOW_LATENCY == 1
+  stopStream();
+#endif
 
-static char s_filename[] = "DXXXXXX.csv";  // This is a holder for the full file name
-static char s_deviceID[3]; // A buffer to hold the device ID
+  unsigned long start = micros();
 
-static char comma = ',';
+#if SD_LOW_LATENCY == 1
+  // Pre-allocate and erase it too (the headers go out with its first block)
+  uint32_t first;
+  uint32_t last;
+  if (file.createContiguous(s_sd.vwd(), filename, contiguousFileBlocks() * SD_SECTOR_SIZE))
+  {
+    if (file.contiguousRange(&first, &last) && eraseBlocks(first, last))
+    {
+      file.close();
+      SDSTATS_AddLatency(SDSTATS_OPEN, micros() - start);
+      return;
+    }
+    file.remove();
+  }
+#endif
 
-// These are Char Strings - they are stored in program memory to save space in data memory
-// These are a mixutre of error messages and serial printed information
-// These MUST be in the same order as the fields are written to the CSV file!
-const char s_pstr_headers[] PROGMEM = \
-  "Ref, Date, Time, " \
-  WINDSPEED_HEADERS \
-  WIND_DIRECTION_HEADERS \
-  TEMPERATURE_HEADERS \
-  IRRADIANCE_HEADERS \
-  EXTERNAL_VOLTS_HEADERS \
-  EXTERNAL_AMPS_HEADERS \
-  "Batt V";
-  
-  
-const char s_pstr_initialised[] PROGMEM = "Init SD OK. Headers:";
-const char s_pstr_not_initialised[] PROGMEM = "Init SD Failed";
-const char s_pstr_noSD[] PROGMEM = "No SD card";
-const char s_pstrerroropen[] PROGMEM = "Error open";
-const char s_pstr_file_already_exists[] PROGMEM = "File already exists";
+  if (file.open(filename, O_RDWR | O_CREAT | O_EXCL))
+  {
+    uint16_t length = buildFileHeader(s_dataString, s_fields);
+    file.write(s_dataString, length);
+    countBytesWritten(length);
+    file.close();
+  }
+  else
+  {
+    SDSTATS_AddOpenFailure();
+  }
+  SDSTATS_AddLatency(SDSTATS_OPEN, micros() - start);
+}
 
 /*
- * Private Functions
+ * fileDay
+ * Returns the date (YYMMDD) of a data or raw file name made by ROTATION_GetFilename
+ * (DYYMMDD[part].ext or YYMMDDHH.ext), or 0 if it is any other file
  */
-
-static void write_configurable_fields(FixedLengthAccumulator * accum)
+static uint32_t fileDay(const char * name)
 {
-  #if READ_WINDSPEED == 1
-  accum->writeChar(comma);
-  WIND_WritePulseCountToBuffer(0, accum);
-  accum->writeChar(comma);
-  WIND_WritePulseCountToBuffer(1, accum);
-  #endif
+  uint32_t day = 0;
+  bool daily = (toupper(*name) == 'D');
+  uint8_t digits = daily ? 6 : 8;
+
+  if (daily) { name++; }
 
-  #if READ_WIND_DIRECTION == 1
-  accum->writeChar(comma);
-  WIND_WriteDirectionToBuffer(accum);
-  #endif
+  for (uint8_t i = 0; i < digits; i++, name++)
+  {
+    if (!isdigit(*name)) { return 0; }
+    if (i < 6) { day = (day * 10) + (*name - '0'); }
+  }
 
-  #if READ_TEMPERATURE == 1
-  accum->writeChar(comma);
-  TEMP_WriteTemperatureToBuffer(accum);
-  #endif
+  // Daily files may have a part after the date
+  if (daily && isalnum(*name)) { name++; }
 
-  #if READ_IRRADIANCE == 1
-  accum->writeChar(comma);
-  IRR_WriteIrradianceToBuffer(accum);
-  #endif
+  if (*name++ != '.') { return 0; }
+  if (strcasecmp(name, SD_FILE_EXTENSION) && strcasecmp(name, SD_RAW_EXTENSION)) { return 0; }
 
-  #if READ_EXTERNAL_VOLTS == 1
-  accum->writeChar(comma);
-  VA_WriteExternalVoltageToBuffer(accum);
-  #endif
-  
-  #if READ_EXTERNAL_AMPS == 1
-  accum->writeChar(comma);
-  VA_WriteExternalCurrentToBuffer(accum);
-  #endif
+  return day;
 }
 
 /*
- * writeDataString
- * Opens the current file for writing and appends the current data string
+ * deleteOldestDay
+ * Deletes all the data and raw files for the oldest day before today. Returns false if there are none.
  */
-static void writeDataString()
+static bool deleteOldestDay()
 {
-    s_datafile.open(s_filename, O_RDWR | O_CREAT | O_AT_END);    // Open the correct file
-    // if the file is available, write to it:
-    if (s_sd.exists(s_filename))
+  SdFile root;
+  SdFile file;
+  char name[13];
+  uint32_t today = fileDay(s_filename);
+  uint32_t oldest = today;
+  uint32_t cluster_bytes = (uint32_t)s_sd.vol()->blocksPerCluster() * SD_SECTOR_SIZE;
+  bool deleted = false;
+
+  if (!root.openRoot(s_sd.vol())) { return false; }
+
+  while (file.openNext(&root, O_READ))
+  {
+    if (file.isFile() && file.getName(name, sizeof(name)))
+    {
+      uint32_t day = fileDay(name);
+      if (day && (day < oldest)) { oldest = day; }
+    }
+    file.close();
+  }
+
+  if (oldest != today)
+  {
+    root.rewind();
+    while (file.openNext(&root, O_READ))
     {
-      s_datafile.println(s_dataString);
-      s_datafile.close();
-      // print to the serial port too:
-      Serial.println(s_dataString);
-    }  
-    // if the file isn't open, pop up an error:
-    else {
-      if(APP_InDebugMode())
+      bool matches = file.isFile() && file.getName(name, sizeof(name)) && (fileDay(name) == oldest);
+      uint16_t index = file.dirIndex();
+      uint32_t blocks = ((file.fileSize() + cluster_bytes - 1) / cluster_bytes) * s_sd.vol()->blocksPerCluster();
+      file.close();
+
+      // Reopening the same directory entry for writing leaves root where it was
+      if (matches && file.open(&root, index, O_RDWR) && file.remove())
       {
-        Serial.println(PStringToRAM(s_pstrerroropen));
+        SPACE_AddFreedKB(blocks / 2);
+        deleted = true;
+        if (APP_InDebugMode())
+        {
+          Serial.print(FLASH_STRING(s_pstr_deleted));
+          Serial.println(name);
+        }
       }
+      file.close();
+    }
+  }
+
+  root.close();
+  return deleted;
+}
+
+/*
+ * checkFreeSpace
+ * Once a day (and after a card is inserted), counts the free clusters and, if the policy allows,
+ * deletes the oldest days of files until there is enough free space
+ */
+static void checkFreeSpace()
+{
+  if ((s_recordDay == 0) || (s_spaceDay == s_recordDay) || !powerUpCard()) { return; }
+  s_spaceDay = s_recordDay;
+
+#if SD_LOW_LATENCY == 1
+  stopStream();
+#endif
+
+  int32_t free_clusters = s_sd.vol()->freeClusterCount();
+  if (free_clusters < 0) { return; }
+  SPACE_SetFreeKB(((uint32_t)free_clusters * s_sd.vol()->blocksPerCluster()) / 2);
+
+  for (uint8_t days = 0; SPACE_IsLow() && (days < SD_MAX_DAYS_DELETED); days++)
+  {
+    if ((SPACE_GetPolicy() != SPACE_DELETE_OLDEST) || !deleteOldestDay())
+    {
+      Serial.println(FLASH_STRING(s_pstr_space_low));
+      break;
+    }
+  }
+}
+
+/*
+ * writeSummary
+ * Appends the summary row for a finished day to SUMMARY.csv (creating it with headers if needed)
+ */
+static void writeSummary()
+{
+  SdFile file;
+
+  if (!SUMMARY_IsPending() || !powerUpCard()) { return; }
+
+#if SD_LOW_LATENCY == 1
+  stopStream();
+#endif
+
+  unsigned long start = micros();
+  bool file_exists = s_sd.exists(SUMMARY_FILENAME);
+
+  if (!file.open(SUMMARY_FILENAME, O_RDWR | O_CREAT | O_AT_END))
+  {
+    SDSTATS_AddOpenFailure();
+    return;
+  }
+
+  if (!file_exists)
+  {
+    s_accumulator.reset();
+    SUMMARY_WriteHeaders(&s_accumulator);
+    file.write(s_dataString, s_accumulator.length());
+    countBytesWritten(s_accumulator.length());
+  }
+
+  s_accumulator.reset();
+  SUMMARY_WriteRow(s_deviceID, &s_accumulator);
+  file.write(s_dataString, s_accumulator.length());
+  countBytesWritten(s_accumulator.length());
+  file.close();
+  SDSTATS_AddLatency(SDSTATS_OPEN, micros() - start);
+
+  if (APP_InDebugMode())
+  {
+    Serial.print(s_accumulator.c_str());
+  }
+
+  SUMMARY_Written();
+}
+
+#if SD_STORE_AND_FORWARD == 1
+/*
+ * writeStoredRecords
+ * Writes the records stored while the card was absent (oldest first) to the files for their dates,
+ * marked as backfilled. Returns true if any were written.
+ */
+static bool writeStoredRecords()
+{
+  char record[SD_RECORD_SIZE];
+  bool written = false;
+
+  while (SD_CardIsPresent() && BACKFILL_Peek(record))
+  {
+    uint32_t period = ROTATION_GetPeriod(BINARY_GetLittleEndian((const uint8_t*)&record[1], 4));
+
+    if ((period != s_filePeriod) || fileIsFull())
+    {
+      openFileForPeriod(period);
+    }
+
+    // A record that can't be written stays stored for the next try
+    record[0] = (char)BINARY_BACKFILL_MARKER;
+    if (!writeRecord(s_dataString, encodeRecord(record, s_fileFields))) { break; }
+    BACKFILL_Drop();
+    written = true;
+  }
+
+  return written;
+}
+#endif
+
+/*
+ * powerDownCard
+ * If SD_POWER_GATING is 1, syncs everything to the card and powers it down until it is next needed.
+ * The SPI pins are left floating, so that the card is not powered through them.
+ */
+static void powerDownCard()
+{
+#if SD_POWER_GATING == 1
+  if (!s_cardPowered) { return; }
+
+  if (SD_CardIsPresent())
+  {
+#if SD_LOW_LATENCY == 1
+    stopStream();
+#endif
+    if (s_datafile.isOpen()) { s_datafile.sync(); }
   }
+
+  SPCR = 0;
+  pinMode(SD_CHIP_SELECT_PIN, INPUT);
+  pinMode(MOSI, INPUT);
+  pinMode(SCK, INPUT);
+  digitalWrite(SD_POWER_PIN, !SD_POWER_ON);
+
+  s_cardOnMillis += millis() - s_powerOnMillis;
+  s_cardPowered = false;
+#endif
 }
 
 /*
+ * changeFile
+ * Moves to the file for a period, first writing out any records stored while the card was absent.
+ * Returns false if the card could not be powered up.
+ */
+static bool changeFile(uint32_t period)
+{
+  if (!powerUpCard()) { return false; }
+
+  openFileForPeriod(period);
+
+#if SD_STORE_AND_FORWARD == 1
+  if (writeStoredRecords() && (s_filePeriod != period))
+  {
+    // The last stored record was from an earlier period
+    openFileForPeriod(period);
+  }
+#endif
 
-#define DATA_STRING_LENGTH 128 
-* Public Functions
+  return true;
+}
+
+/*
+ * Public Functions
  */
 
 /*
@@ -153,34 +2170,78 @@ static void writeDataString()
  */
 void SD_Setup()
 {
-    pinMode(SD_CARD_DETECT_PIN,INPUT);  // D9 is the SD card detect on pin 9.
+  pinMode(SD_CARD_DETECT_PIN,INPUT);  // D9 is the SD card detect on pin 9.
 
   // make sure that the default chip select pin is set to
   // output, even if you don't use it:
-    pinMode(SD_CHIP_SELECT_PIN, OUTPUT);
+  pinMode(SD_CHIP_SELECT_PIN, OUTPUT);
 
-  // Initialize the SD card at SPI_HALF_SPEED to avoid bus errors 
-  // We use SPI_HALF_SPEED here as I am using resistor level shifters.
+#if SD_POWER_GATING == 1
+  // The card is powered up when it is first used
+  pinMode(SD_POWER_PIN, OUTPUT);
+  digitalWrite(SD_POWER_PIN, !SD_POWER_ON);
+#endif
 
   s_accumulator.attach(s_dataString, DATA_STRING_LENGTH);
 
-  if (!s_sd.begin(SD_CHIP_SELECT_PIN, SPI_HALF_SPEED)) {
-    if(APP_InDebugMode())
-    {
-      Serial.println(PStringToRAM(s_pstr_not_initialised));
-    }
-  // don't do anything more:
-  // Want to turn on an ERROR LED here
-  	return;
+  // Picks up any records stored in EEPROM before a reset
+  BACKFILL_Setup(SD_RECORD_SIZE);
+
+  ROTATION_Setup();
+  SPACE_Setup();
+
+  s_spiDivisor = EEPROM_GetSpiDivisor();
+  if ((s_spiDivisor != SPI_FULL_SPEED) && (s_spiDivisor != SPI_HALF_SPEED) && (s_spiDivisor != SPI_QUARTER_SPEED))
+  {
+    s_spiDivisor = SD_SPI_NOT_PROBED;
   }
-  else
+
+  // A card that is already in at power-up does not need debouncing
+  if (digitalRead(SD_CARD_DETECT_PIN) == LOW)
+  {
+    s_cardDetectSeconds = SD_CARD_DEBOUNCE_SECONDS;
+    s_cardState = SD_CARD_INSERTED;
+  }
+}
+
+/*
+ * SD_ServiceCard
+ * Initialises a newly inserted card and opens today's file, or creates the next file
+ * ahead of a rollover. Called from the main loop after any sample has been written,
+ * so that a sample write never waits for a card to initialise or a new file to be set up.
+ */
+void SD_ServiceCard()
+{
+  if (SD_CardIsPresent())
+  {
+    // Get the next file ready before the rollover
+    createNextFile();
+    writeSummary();
+    checkFreeSpace();
+  }
+  else if (changeCardState(SD_CARD_INSERTED, SD_CARD_INITIALISING))
   {
-  	if(APP_InDebugMode())
-  	{
-  		Serial.println(PStringToRAM(s_pstr_initialised));
-      Serial.println(PStringToRAM(s_pstr_headers));
-  	}
+    s_cardRetrySeconds = 0;
+    bool initialised = initialiseCard();
+
+    if (changeCardState(SD_CARD_INITIALISING, initialised ? SD_CARD_READY : SD_CARD_FAILED) && initialised)
+    {
+      // Any records stored while the card was out are written first
+      SD_CreateFileForToday();
+    }
   }
+
+  // Nothing else uses the card until the next sample
+  powerDownCard();
+}
+
+/*
+ * SD_GetCardState
+ * Returns the state of the SD card (see sd_card_state)
+ */
+uint8_t SD_GetCardState()
+{
+  return s_cardState;
 }
 
 /*
@@ -199,51 +2260,226 @@ void SD_SetDeviceID(char * id)
  */
 void SD_SetSampleTime(long newSampleTime)
 {
+	// Read by the tick interrupt
+	noInterrupts();
 	s_sampleTime = newSampleTime;
+	interrupts();
+}
+
+
+/*
+ * SD_SetFieldMask
+ * Chooses which of the fields compiled in (binary_field_flags from BINARY_FIELD_WINDSPEED to
+ * BINARY_FIELD_EXTERNAL_AMPS) are read and recorded. The battery voltage is always recorded.
+ * The new fields start with the next record, in a new file (see createFileForPeriod).
+ */
+void SD_SetFieldMask(uint8_t mask)
+{
+  // Unprogrammed EEPROM reads as 0xFF
+  if (mask == 0xFF) { mask = SD_DEFAULT_FIELD_MASK; }
+
+  uint8_t fields = (mask & SD_TABLE_FIELDS) | (SD_BINARY_FIELDS & ~SD_TABLE_FIELDS);
+  if (fields != s_fields)
+  {
+    s_fields = fields;
+    s_fieldsChanged = true;
+  }
+}
+
+/*
+ * SD_GetFieldMask
+ * Returns the fields being recorded (see SD_SetFieldMask)
+ */
+uint8_t SD_GetFieldMask()
+{
+  return s_fields & SD_TABLE_FIELDS;
+}
+
+/*
+ * SD_FieldIsRecorded
+ * Returns true if the readings for a field (a binary_field_flags value) are needed
+ */
+bool SD_FieldIsRecorded(uint8_t flag)
+{
+  return ((s_fields | s_fileFields) & flag) != 0;
+}
+
+/*
+ * SD_PrintFields
+ * Prints the field mask and the column headers for the fields
+ */
+void SD_PrintFields()
+{
+  Serial.print(FLASH_STRING(s_pstr_fields));
+  Serial.println(SD_GetFieldMask());
+  Serial.write(s_dataString, buildCsvHeader(s_dataString, s_fields));
+  Serial.println();
 }
 
 /*
  * SD_CreateFileForToday
- * Creates a new file if one doesn't exist for current date.
+ * Creates a new file if one doesn't exist for current date (or hour, or part; see file_rotation.cpp).
+ * Any records stored while the card was absent are written first.
  */
 void SD_CreateFileForToday()
 {
-  // Check there is a file created with the date in the title
-  // If it does then create a new one with the new name
-  // The name is created from:
-  // DMMDDYY.CSV, where YY is the year MM is the month, DD is the day
-  // You must add on the '0' to convert to ASCII
+  // The file is opened when the card is ready
+  if (!SD_CardIsPresent()) { return; }
+
+  changeFile(ROTATION_GetPeriod(getTimestamp(RTC_GetDate(RTCC_DATE_WORLD), RTC_GetTime())));
+}
 
-	RTC_GetYYMMDDString(&s_filename[1]);
+/*
+ * SD_WriteRawSecond
+ * Adds the last second's pulse counts and wind vane direction index to the raw stream.
+ * Called from the main loop, but only takes a sample once per tick. The seconds are written
+ * BINARY_RAW_SECONDS at a time, so most calls do not touch the card.
+ */
+void SD_WriteRawSecond(uint8_t direction)
+{
+#if SD_RAW_STREAM == 1
+  uint8_t ticks = s_rawTicks;
+  uint8_t elapsed = ticks - s_rawLastTick;
+  uint8_t pulses[2];
 
-	if(APP_InDebugMode())
-	{
-		Serial.println(s_filename);
-	}
+  // The loop runs more than once a second in calibrate mode
+  if (elapsed == 0) { return; }
+  s_rawLastTick = ticks;
 
-	if(!s_sd.exists(s_filename))
-	{
-    // open the file for write at end like the Native SD library
-		if (!s_datafile.open(s_filename, O_RDWR | O_CREAT | O_AT_END)) 
-		{
-      if(APP_InDebugMode())
-      {
-        Serial.println(PStringToRAM(s_pstrerroropen));
-      }
-		}
-    // if the file opened okay, write to it and sync:
-    s_datafile.println(PStringToRAM(s_pstr_headers));
-		s_datafile.sync();
-	} 
+  WIND_GetSecondPulseCounts(pulses);
 
-	else
-	{
-    if(APP_InDebugMode())
+  // The seconds in a chunk must be consecutive
+  if (elapsed != 1) { writeRawChunk(); }
+
+  if (s_rawChunk.count == 0)
+  {
+    uint32_t timestamp = getTimestamp(RTC_GetDate(RTCC_DATE_WORLD), RTC_GetTime());
+    uint32_t period = ROTATION_GetPeriod(timestamp);
+    uint32_t remaining = ROTATION_GetSecondsToNextPeriod(timestamp);
+
+    // Chunks never straddle a file change
+    if (SD_CardIsPresent() && (period != s_filePeriod))
     {
-      Serial.println(PStringToRAM(s_pstr_file_already_exists));
+      changeFile(period);
     }
-	}
 
+    memset(&s_rawChunk, 0, sizeof(s_rawChunk));
+    s_rawChunk.timestamp = timestamp;
+    s_rawChunkLimit = (remaining < BINARY_RAW_SECONDS) ? (uint8_t)remaining : BINARY_RAW_SECONDS;
+  }
+
+  struct binary_raw_second * second = &s_rawChunk.seconds[s_rawChunk.count++];
+  second->pulses[0] = pulses[0];
+  second->pulses[1] = pulses[1];
+  second->direction = direction;
+
+  if (s_rawChunk.count >= s_rawChunkLimit) { writeRawChunk(); }
+#else
+  (void)direction;
+#endif
+}
+
+/*
+ * SD_GetSpiDivisor
+ * Returns the SPI clock divisor used for the card (2 = full speed, 4 = half, 8 = quarter), or 0 if not yet found
+ */
+uint8_t SD_GetSpiDivisor()
+{
+  return s_spiDivisor;
+}
+
+/*
+ * SD_ProbeSpiClock
+ * Forgets the cached SPI clock, so that the card is started again at the fastest clock that passes the check
+ */
+void SD_ProbeSpiClock()
+{
+  s_spiDivisor = SD_SPI_NOT_PROBED;
+  EEPROM_SetSpiDivisor(SD_SPI_NOT_PROBED);
+  changeCardState(SD_CARD_READY, SD_CARD_INSERTED);
+}
+
+/*
+ * SD_SetSyncRecords
+ * Changes the number of records written between each sync of the data file
+ */
+void SD_SetSyncRecords(uint16_t records)
+{
+#if SD_KEEP_FILE_OPEN == 1
+  // Unprogrammed EEPROM reads as 0xFFFF
+  if ((records == 0) || (records == 0xFFFF))
+  {
+    records = SD_DEFAULT_SYNC_RECORDS;
+  }
+  s_syncRecords = records;
+#else
+  (void)records;
+#endif
+}
+
+/*
+ * SD_Sync
+ * Forces any cached data out to the card
+ */
+void SD_Sync()
+{
+  if (SD_CardIsPresent() && powerUpCard())
+  {
+#if SD_WRITE_BEHIND == 1
+    commitQueue();
+#endif
+#if SD_LOW_LATENCY == 1
+    if (s_rawMode) { return; }
+#endif
+    syncDataFile();
+  }
+}
+
+/*
+ * SD_GetPendingRecordCount
+ * Returns the number of records waiting in RAM to be written to the card
+ */
+uint16_t SD_GetPendingRecordCount()
+{
+#if SD_WRITE_BEHIND == 1
+  return s_queuedRecords;
+#else
+  return 0;
+#endif
+}
+
+/*
+ * SD_PrintStatistics
+ * Prints the record write and sync counts and average record encode time to serial
+ */
+void SD_PrintStatistics()
+{
+  Serial.print(FLASH_STRING(s_pstr_writes));
+  Serial.println(s_writeCount);
+  Serial.print(FLASH_STRING(s_pstr_syncs));
+  Serial.println(SDSTATS_GetCount(SDSTATS_SYNC));
+  Serial.print(FLASH_STRING(s_pstr_pending));
+  Serial.println(SD_GetPendingRecordCount());
+  Serial.print(FLASH_STRING(s_pstr_encode));
+  Serial.println(s_encodeCount ? (s_encodeMicros / s_encodeCount) : 0);
+  Serial.print(FLASH_STRING(s_pstr_card));
+  Serial.println(s_cardState);
+  Serial.print(FLASH_STRING(s_pstr_spi));
+  Serial.println(s_spiDivisor);
+#if SD_POWER_GATING == 1
+  // Energy used by the card per record, estimated from the time it has been powered
+  unsigned long on_ms = s_cardOnMillis + (s_cardPowered ? (millis() - s_powerOnMillis) : 0);
+  Serial.print(FLASH_STRING(s_pstr_card_on));
+  Serial.println(on_ms);
+  Serial.print(FLASH_STRING(s_pstr_energy));
+  Serial.println(s_encodeCount ? (((float)on_ms * SD_CARD_ACTIVE_MA * SD_CARD_SUPPLY_MV) / 1000.0 / s_encodeCount) : 0.0, 0);
+#endif
+#if SD_STORE_AND_FORWARD == 1
+  Serial.print(FLASH_STRING(s_pstr_stored));
+  Serial.println(BACKFILL_GetCount());
+  Serial.print(FLASH_STRING(s_pstr_lost));
+  Serial.println(BACKFILL_GetLostCount());
+#endif
 }
 
 /***************************************************
@@ -278,98 +2514,86 @@ void SD_CreateFileForToday()
 
  void SD_WriteData()
  {
-  const char * current_date;
-  const char * current_time;
-
-  // *********** WIND SPEED ******************************************
-  // Want to get the number of pulses and average into the sample time
-  // This gives us the average wind speed
-  // pulsecounterold holds the value of pulses.
-  // This can be converted into the wind speed using the time and 
-  // the pulse-wind speed characterisitic of the anemometer.
-  // Do this as post processing - pulse count is most important.
-
-  // *********** WIND DIRECTION **************************************
-  // This can be checked every second and an average used
-    // If this interrupt has happened then we want to write data to SD card:
-  // Save the pulsecounter value (this will be stored to write to SD card)
-  WIND_StoreWindPulseCounts();
-  WIND_AnalyseWindDirection();
-
-  // *********** TEMPERATURE *****************************************
-  // Two versions of this - either with thermistor or I2C sensor (if connected)
-  // Thermistor version
-  // Get the temperature readings and store to variables   
-
-  BATT_UpdateBatteryVoltage();
-
-    // *********** EXTERNAL VOLTAGE ***************************************
-    // From Vcc-680k--46k-GND potential divider
-  VA_UpdateExternalVoltage();
-
-    // ********** EXTERNAL CURRENTS **************************************
-    // Measured using a hall effect current sensor
-    // Either using a ACS*** or a LEM HTFS 200-P
-    // Comment out whichever you are not using
-
-  VA_UpdateExternalCurrent();
-
-    // ******** put this data into a file ********************************
-    // ****** Check filename *********************************************
-    // Each day we want to write a new file.
-    // Compare date with previous stored date, every second
-  current_date = RTC_GetDate(RTCC_DATE_WORLD);
-  current_time = RTC_GetTime();
+  unsigned long write_start = micros();
+  uint32_t timestamp;
+  uint32_t period;
+  uint16_t length;
 
-  if(strcmp(current_date, s_last_used_date) != 0)
-  {
-     // If date has changed then create a new file
-     memcpy(s_last_used_date, current_date, 10);
-     SD_CreateFileForToday();  // Create the corrct filename (from date)
-  }    
+  // The card state can be changed by the tick interrupt (card detect), so it is only read once:
+  // each record then goes either to the card or to the backfill store, never both or neither
+  bool card_present = SD_CardIsPresent();
 
-  s_accumulator.reset();
-  s_accumulator.writeChar(s_deviceID[0]);
-  s_accumulator.writeChar(s_deviceID[1]);
-  s_accumulator.writeChar(comma);
-  s_accumulator.writeString(current_date);
-  s_accumulator.writeChar(comma);
-  s_accumulator.writeString(current_time);
+  // Take the readings for each field in the field table (fields.h) that is being recorded
+  // (fields that are not in the field mask are not read at all, unless the current file still has them).
+  // The wind pulse counts for the period are saved here, and the wind direction worked out from
+  // the readings taken every second. The pulse counts can be converted into the wind speed using
+  // the time and the pulse-wind speed characterisitic of the anemometer. Do this as post processing.
+  uint8_t fields = s_fields | s_fileFields;
+  SD_FIELDS(FIELD_UPDATE)
 
-  write_configurable_fields(&s_accumulator);
+  timestamp = getTimestamp(RTC_GetDate(RTCC_DATE_WORLD), RTC_GetTime());
 
-  s_accumulator.writeChar(comma); 
-  BATT_WriteVoltageToBuffer(&s_accumulator);
+  unsigned long encode_start = micros();
+  buildBinaryRecord(s_record, timestamp, fields);
+  s_encodeMicros += micros() - encode_start;
 
-  // ************** Write it to the SD card *************
-  // This depends upon the card detect.
-  // If card is there then write to the file
-  // If card has recently been inserted then initialise the card/filenames
-  // If card is not there then flash LEDs
+  // The summary row for the day before is written by SD_ServiceCard
+  SUMMARY_AddRecord(timestamp, (uint32_t)s_sampleTime, fields);
 
-  if(digitalRead(SD_CARD_DETECT_PIN)==LOW&&s_lastCardDetect==HIGH)
+    // ******** put this data into a file ********************************
+    // ****** Check filename *********************************************
+    // Each day (or hour, or when the file is full) we want to write a new file.
+    // The new file has usually been created already by SD_ServiceCard.
+  period = ROTATION_GetPeriod(timestamp);
+  if (card_present && ((period != s_filePeriod) || fileIsFull() || s_fieldsChanged))
   {
-    delay(100);  // Wait for switch to settle down.
-    // There was no card previously so re-initialise and re-check the filename
-    SD_Setup();
-    SD_CreateFileForToday();
+    // A card that won't power up gets no record: it is stored instead
+    card_present = changeFile(period);
   }
-  if(digitalRead(SD_CARD_DETECT_PIN)==LOW&&s_lastCardDetect==LOW)
+
+  // Encoded for the file it is going into (changeFile also uses s_dataString)
+  encode_start = micros();
+  length = encodeRecord(s_record, card_present ? s_fileFields : s_fields);
+  s_encodeMicros += micros() - encode_start;
+  s_encodeCount++;
+
+  // ************** Write it to the SD card *************
+  // This depends upon the card state.
+  // If card is ready then write to the file
+  // A newly inserted card is initialised by SD_ServiceCard, not here
+  // If card is not ready then flash LEDs
+
+  if(card_present)
   {
       //Ensure that there is a card present)
       // We then write the data to the SD card here:
-    writeDataString();
+    if (!writeRecord(s_dataString, length))
+    {
+      // Keep the record until the card can be written again (writeRecord has reset the deltas)
+      BACKFILL_Store(s_record);
+    }
+    // print to the serial port too:
+    printRecord(length);
+
+    s_recordDay = timestamp & ~0x1FFFFUL;
+    SPACE_AddSeconds((uint32_t)s_sampleTime);
+
+    planNextFile(timestamp);
   }
   else
   {
+    // Keep the record until the card is back.
+    // This record is not on the card, so the next one cannot be a delta against it
+    BACKFILL_Store(s_record);
+    DELTA_Reset();
      // print to the serial port too:
-    Serial.println(PStringToRAM(s_pstr_noSD));
-    Serial.println(s_dataString);
+    Serial.println(FLASH_STRING(s_pstr_noSD));
+    printRecord(length);
   }   
     
-    s_lastCardDetect = digitalRead(SD_CARD_DETECT_PIN);  // Store the old value of the card detect
-    
     s_writePending = false;
+
+  SDSTATS_AddLatency(SDSTATS_WRITE_DATA, micros() - write_start);
 }
 
 /***************************************************
@@ -385,7 +2609,14 @@ void SD_CreateFileForToday()
  ***************************************************/
 void SD_SecondTick()
 {
+  updateCardDetect();
   s_dataCounter++;
+#if SD_RAW_STREAM == 1
+  s_rawTicks++;
+#endif
+#if SD_KEEP_FILE_OPEN == 1
+  if (s_secondsSinceSync < 255) { s_secondsSinceSync++; }
+#endif
   if ((s_writePending == false) && (s_dataCounter >= s_sampleTime))  // This stops us loosing data if a second is missed
   { 
     // Reset the DataCounter
@@ -406,20 +2637,23 @@ void SD_SecondTick()
  ***************************************************/
 void SD_ResetCounter()
 {
+    // The tick interrupt can run at any time, and the counter is 4 bytes
+    noInterrupts();
     s_dataCounter = 0;
+    interrupts();
 }
 
 /***************************************************
- *  Name:        SD_ResetCounter
+ *  Name:        SD_CardIsPresent
  *
- *  Returns:     TRUE if SD card is present
+ *  Returns:     TRUE if SD card is present and initialised
  *
  *  Parameters:  None.
  *
- *  Description: Tests the card detect pin (LOW if card present)
+ *  Description: Tests the (debounced) card state
  *
  ***************************************************/
 bool SD_CardIsPresent()
 {
-  return digitalRead(SD_CARD_DETECT_PIN)==LOW;
+  return s_cardState == SD_CARD_READY;
 }
@@ -1,11 +1,29 @@
 #ifndef _SD_H_
 #define _SD_H_
 
+enum sd_card_state
+{
+	SD_CARD_REMOVED,
+	SD_CARD_INSERTED, // Waiting for SD_ServiceCard to initialise it
+	SD_CARD_INITIALISING,
+	SD_CARD_READY,
+	SD_CARD_FAILED // Initialisation is retried every SD_CARD_RETRY_SECONDS
+};
+
 void SD_Setup();
+void SD_ServiceCard();
+uint8_t SD_GetCardState();
+uint8_t SD_GetSpiDivisor();
+void SD_ProbeSpiClock();
 void SD_CreateFileForToday();
+void SD_WriteRawSecond(uint8_t direction);
 void SD_SetDeviceID(char * id);
 
 void SD_SetSampleTime(long newSampleTime);
+void SD_SetFieldMask(uint8_t mask);
+uint8_t SD_GetFieldMask();
+bool SD_FieldIsRecorded(uint8_t flag);
+void SD_PrintFields();
 bool SD_CardIsPresent();
 void SD_WriteData();
 void SD_ForcePendingWrite();
@@ -13,4 +31,9 @@ bool SD_WriteIsPending();
 void SD_ResetCounter();
 void SD_SecondTick();
 
+void SD_SetSyncRecords(uint16_t records);
+void SD_Sync();
+void SD_PrintStatistics();
+uint16_t SD_GetPendingRecordCount();
+
 #endif
\ No newline at end of file
@@ -0,0 +1,162 @@
+/*
+ * sd_stats.cpp
+ *
+ * SD card write latency and I/O counters for Wind Data logger.
+ *
+ * The time taken by each SD_WriteData is kept in a histogram with logarithmic buckets,
+ * so that occasional card stalls show up alongside the typical write time.
+ * The open, close and sync calls are counted with their maximum latency.
+ *
+ * James Fowkes
+ */
+
+#include <Arduino.h>
+
+/*
+ * Application Includes
+ */
+
+#include "app.h"
+#include "utility.h"
+#include "sd_stats.h"
+
+/* 
+ * Private Variables
+ */
+
+static uint16_t s_histogram[SDSTATS_BUCKETS]; // Counts stop at 65535
+static unsigned long s_counts[SDSTATS_OPERATIONS];
+static unsigned long s_maxLatency[SDSTATS_OPERATIONS];
+
+static unsigned long s_bytesWritten = 0;
+static uint16_t s_openFailures = 0;
+static uint16_t s_reinitialisations = 0;
+
+const char s_pstr_histogram[] PROGMEM = "Write us histogram (<bound:count):";
+const char s_pstr_over[] PROGMEM = ">=";
+const char s_pstr_operations[] PROGMEM = "Write\0Open\0Close\0Sync";
+const char s_pstr_count[] PROGMEM = " n:";
+const char s_pstr_max[] PROGMEM = " max us:";
+const char s_pstr_bytes[] PROGMEM = "Bytes:";
+const char s_pstr_open_failures[] PROGMEM = "Open fails:";
+const char s_pstr_reinitialisations[] PROGMEM = "Card inits:";
+
+/* 
+ * Private Functions
+ */
+
+/*
+ * bucketForLatency
+ * Returns the histogram bucket for a latency
+ */
+static uint8_t bucketForLatency(unsigned long latency_us)
+{
+	uint8_t bucket = 0;
+
+	latency_us >>= 8;
+	while (latency_us && (bucket < (SDSTATS_BUCKETS - 1)))
+	{
+		latency_us >>= 1;
+		bucket++;
+	}
+	return bucket;
+}
+
+/* 
+ * Public Functions
+ */
+
+/*
+ * SDSTATS_AddLatency
+ * Adds the time taken by one operation
+ */
+void SDSTATS_AddLatency(uint8_t operation, unsigned long latency_us)
+{
+	if (operation >= SDSTATS_OPERATIONS) { return; }
+
+	s_counts[operation]++;
+	if (latency_us > s_maxLatency[operation]) { s_maxLatency[operation] = latency_us; }
+
+	if (operation == SDSTATS_WRITE_DATA)
+	{
+		uint8_t bucket = bucketForLatency(latency_us);
+		if (s_histogram[bucket] < 0xFFFF) { s_histogram[bucket]++; }
+	}
+}
+
+void SDSTATS_AddBytesWritten(uint16_t bytes)
+{
+	s_bytesWritten += bytes;
+}
+
+void SDSTATS_AddOpenFailure(void)
+{
+	s_openFailures++;
+}
+
+void SDSTATS_AddReinitialisation(void)
+{
+	s_reinitialisations++;
+}
+
+unsigned long SDSTATS_GetCount(uint8_t operation)
+{
+	return (operation < SDSTATS_OPERATIONS) ? s_counts[operation] : 0;
+}
+
+/*
+ * SDSTATS_Print
+ * Prints the histogram and counters to serial
+ */
+void SDSTATS_Print(void)
+{
+	const char * name = s_pstr_operations;
+
+	Serial.println(FLASH_STRING(s_pstr_histogram));
+	for (uint8_t i = 0; i < SDSTATS_BUCKETS; i++)
+	{
+		if (i == (SDSTATS_BUCKETS - 1))
+		{
+			Serial.print(FLASH_STRING(s_pstr_over));
+			Serial.print(256UL << (i - 1));
+		}
+		else
+		{
+			Serial.print('<');
+			Serial.print(256UL << i);
+		}
+		Serial.print(':');
+		Serial.println(s_histogram[i]);
+	}
+
+	for (uint8_t i = 0; i < SDSTATS_OPERATIONS; i++)
+	{
+		Serial.print(FLASH_STRING(name));
+		Serial.print(FLASH_STRING(s_pstr_count));
+		Serial.print(s_counts[i]);
+		Serial.print(FLASH_STRING(s_pstr_max));
+		Serial.println(s_maxLatency[i]);
+		name += strlen_P(name) + 1;
+	}
+
+	Serial.print(FLASH_STRING(s_pstr_bytes));
+	Serial.println(s_bytesWritten);
+	Serial.print(FLASH_STRING(s_pstr_open_failures));
+	Serial.println(s_openFailures);
+	Serial.print(FLASH_STRING(s_pstr_reinitialisations));
+	Serial.println(s_reinitialisations);
+}
+
+/*
+ * SDSTATS_Reset
+ * Clears the histogram and counters
+ */
+void SDSTATS_Reset(void)
+{
+	memset(s_histogram, 0, sizeof(s_histogram));
+	memset(s_counts, 0, sizeof(s_counts));
+	memset(s_maxLatency, 0, sizeof(s_maxLatency));
+	s_bytesWritten = 0;
+	s_openFailures = 0;
+	s_reinitialisations = 0;
+}
@@ -0,0 +1,27 @@
+#ifndef _SD_STATS_H_
+#define _SD_STATS_H_
+
+// Defines
+#define SDSTATS_BUCKETS 14 // Bucket 0 is under 256us, each bucket after that doubles, the last is 1.05s and over
+
+enum sdstats_operation
+{
+	SDSTATS_WRITE_DATA, // All of SD_WriteData (this is the one with the histogram)
+	SDSTATS_OPEN,
+	SDSTATS_CLOSE,
+	SDSTATS_SYNC,
+	SDSTATS_OPERATIONS
+};
+
+// Public Functions
+void SDSTATS_AddLatency(uint8_t operation, unsigned long latency_us);
+void SDSTATS_AddBytesWritten(uint16_t bytes);
+void SDSTATS_AddOpenFailure(void);
+void SDSTATS_AddReinitialisation(void);
+
+unsigned long SDSTATS_GetCount(uint8_t operation);
+
+void SDSTATS_Print(void);
+void SDSTATS_Reset(void);
+
+#endif
@@ -15,6 +15,9 @@
 #include "serial_handler.h"
 #include "eeprom_storage.h"
 #include "sd.h"
+#include "sd_stats.h"
+#include "file_rotation.h"
+#include "card_space.h"
 #include "rtc.h"
 #include "utility.h"
 #include "external_volts_amps.h"
@@ -42,7 +45,7 @@ static void setReferenceFromBuffer(int i)
     SD_SetDeviceID(&s_strBuffer[i+1]);
     EEPROM_SetDeviceID(&s_strBuffer[i+1]);
 
-    Serial.print(PStringToRAM(reference));
+    Serial.print(FLASH_STRING(reference));
     Serial.print(s_strBuffer[i+1]);
     Serial.println(s_strBuffer[i+2]);
     SD_CreateFileForToday();
@@ -112,6 +115,138 @@ static void setSampleTimeFromBuffer(int i)
     SD_SetSampleTime(sampleTime);
 }
 
+/*
+ * syncFromBuffer
+ * Either sets the number of records between syncs (Y???E)
+ * or forces a sync and prints the write statistics (YE)
+ */
+static void syncFromBuffer(int i)
+{
+    if (isdigit(s_strBuffer[i+1]))
+    {
+        uint16_t records = (uint16_t)atoi(&s_strBuffer[i+1]);
+
+        EEPROM_SetSyncRecords(records);
+        SD_SetSyncRecords(records);
+
+        Serial.print("Sync Records:");
+        Serial.println(records);
+    }
+    else
+    {
+        SD_Sync();
+        SD_PrintStatistics();
+    }
+}
+
+/*
+ * rotationFromBuffer
+ * Sets when a new data file is started: daily (F0E), hourly (F1E)
+ * or daily and whenever the file reaches ???? KB (F2????E)
+ */
+static void rotationFromBuffer(int i)
+{
+    if (!isdigit(s_strBuffer[i+1])) { return; }
+
+    uint8_t mode = s_strBuffer[i+1] - '0';
+    uint16_t max_kb = (uint16_t)atoi(&s_strBuffer[i+2]);
+
+    ROTATION_SetMode(mode, max_kb);
+
+    Serial.print("Rotation:");
+    Serial.print(ROTATION_GetMode());
+    Serial.print(' ');
+    Serial.println(ROTATION_GetMaxBytes() / 1024);
+
+    // The current file name may have changed
+    SD_CreateFileForToday();
+}
+
+/*
+ * spaceFromBuffer
+ * "CE" prints the free space and days left on the SD card.
+ * "C0E" never deletes files, "C1????E" deletes the oldest days of files when there is less than ???? MB free.
+ */
+static void spaceFromBuffer(int i)
+{
+    if (isdigit(s_strBuffer[i+1]))
+    {
+        SPACE_SetPolicy(s_strBuffer[i+1] - '0', (uint16_t)atoi(&s_strBuffer[i+2]));
+    }
+
+    SPACE_Print();
+}
+
+/*
+ * spiFromBuffer
+ * "PE" prints the SPI clock divisor used for the SD card, "P0E" finds the fastest clock again
+ */
+static void spiFromBuffer(int i)
+{
+    if (s_strBuffer[i+1] == '0')
+    {
+        SD_ProbeSpiClock();
+    }
+
+    Serial.print("SPI div:");
+    Serial.println(SD_GetSpiDivisor());
+}
+
+/*
+ * fieldsFromBuffer
+ * "ME" prints the fields being recorded, "M???E" sets them from the sum of the field numbers
+ * (1 wind speed, 2 direction, 4 temperature, 8 irradiance, 16 external volts, 32 external amps).
+ * The new fields start in a new file.
+ */
+static void fieldsFromBuffer(int i)
+{
+    if (isdigit(s_strBuffer[i+1]))
+    {
+        uint8_t mask = (uint8_t)atoi(&s_strBuffer[i+1]);
+
+        EEPROM_SetFieldMask(mask);
+        SD_SetFieldMask(mask);
+    }
+
+    SD_PrintFields();
+}
+
+/*
+ * debounceFromBuffer
+ * "KE" prints the anemometer pulse lockout time and the time the check takes in each pulse interrupt,
+ * "K???E" sets the lockout time to ??? ms (0 counts every pulse)
+ */
+static void debounceFromBuffer(int i)
+{
+    if (isdigit(s_strBuffer[i+1]))
+    {
+        int ms = atoi(&s_strBuffer[i+1]);
+        if (ms > WIND_MAX_DEBOUNCE_MS) { ms = WIND_MAX_DEBOUNCE_MS; }
+
+        EEPROM_SetDebounceMs((uint8_t)ms);
+        WIND_SetDebounce((uint8_t)ms);
+    }
+
+    WIND_PrintDebounce();
+}
+
+/*
+ * latencyFromBuffer
+ * Either prints the SD write latency histogram and I/O counters (LE)
+ * or clears them (L0E)
+ */
+static void latencyFromBuffer(int i)
+{
+    if (s_strBuffer[i+1] == '0')
+    {
+        SDSTATS_Reset();
+    }
+    else
+    {
+        SDSTATS_Print();
+    }
+}
+
 /*
 * Public Functions
 */
@@ -194,6 +329,41 @@ void SERIAL_HandleCalibrationData()
                     VA_StoreNewCurrentGain(value);
                 }   
 
+                if(s_strBuffer[i]=='Y')
+                {
+                    syncFromBuffer(i);
+                }
+
+                if(s_strBuffer[i]=='L')
+                {
+                    latencyFromBuffer(i);
+                }
+
+                if(s_strBuffer[i]=='F')
+                {
+                    rotationFromBuffer(i);
+                }
+
+                if(s_strBuffer[i]=='C')
+                {
+                    spaceFromBuffer(i);
+                }
+
+                if(s_strBuffer[i]=='P')
+                {
+                    spiFromBuffer(i);
+                }
+
+                if(s_strBuffer[i]=='M')
+                {
+                    fieldsFromBuffer(i);
+                }
+
+                if(s_strBuffer[i]=='K')
+                {
+                    debounceFromBuffer(i);
+                }
+
                 if(s_strBuffer[i]=='W')
                 {    
                     if (s_strBuffer[i+1]=='1')
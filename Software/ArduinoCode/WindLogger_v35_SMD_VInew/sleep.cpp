@@ -11,8 +11,21 @@
 #include <avr/sleep.h>
 #include <avr/power.h>
 
+#include "app.h"
 #include "sleep.h"
 #include "rtc.h"
+#include "utility.h"
+#include "wind.h"
+
+#if (READ_WINDSPEED == 1) && (READ_WIND_PERIODS == 1)
+// Timer1 timestamps the anemometer pulses (see wind.cpp) and stops in power-down,
+// so sleep in idle mode with Timer1 left powered. This takes a few mA more.
+#define SLEEP_MODE SLEEP_MODE_IDLE
+#define SLEEP_POWERED_MODULES _BV(PRTIM1)
+#else
+#define SLEEP_MODE SLEEP_MODE_PWR_DOWN
+#define SLEEP_POWERED_MODULES 0
+#endif
 
 /***************************************************
  *  Name:        SLEEP_SetWakeOnRTCAndSleep
@@ -21,26 +34,45 @@
  *
  *  Parameters:  None.
  *
- *  Description: Enters the arduino into sleep mode (turns on RTC interrupt).
+ *  Description: Enters the arduino into sleep mode until the next RTC interrupt.
+ *               Other interrupts (anemometer pulses, Timer1 overflows) also
+ *               wake the CPU, so it goes back to sleep until the RTC has ticked.
  *
  ***************************************************/
 void SLEEP_SetWakeOnRTCAndSleep(void)
 {
-  RTC_EnableInterrupt();
+  RTC_ClearTick();
   
   sleep_enable();
-   
-  set_sleep_mode(SLEEP_MODE_PWR_DOWN);  
   
   byte old_ADCSRA = ADCSRA;  // Store the old value to re-enable 
   // disable ADC
   ADCSRA = 0;
 
   byte old_PRR = PRR;  // Store previous version on PRR
-  // turn off various modules
-  PRR = 0b11111111;
   
-  sleep_cpu();
+  noInterrupts();
+  while (!RTC_HasTicked())
+  {
+    // turn off various modules
+    if (WIND_LockoutIsRunning())
+    {
+      // The anemometer pulse lockout is timed with micros(), so leave Timer0 running until it is over
+      set_sleep_mode(SLEEP_MODE_IDLE);
+      PRR = (byte)~(SLEEP_POWERED_MODULES | _BV(PRTIM0));
+    }
+    else
+    {
+      set_sleep_mode(SLEEP_MODE);
+      PRR = (byte)~SLEEP_POWERED_MODULES;
+    }
+
+    // sei() only takes effect after the next instruction, so a tick can't be missed between the check and sleeping
+    interrupts();
+    sleep_cpu();
+    noInterrupts();
+  }
+  interrupts();
   /* The program will continue from here. */
   /************* ASLEEP *******************/
   
@@ -15,6 +15,7 @@
 
 #include "app.h"
 #include "utility.h"
+#include "fixed_point.h"
 
 /* 
  * Defines and Typedefs
@@ -27,6 +28,7 @@ enum {
 };
 
 #define THERMISTOR_PIN A0  // This is the analog pin for the thermistor
+#define THERMISTOR_BALANCE_OHMS 10000.0f // The balance resistor for the thermistor
 
 /* Thermistor data for use in thermistor_to_temperature function */
 struct thermistor
@@ -43,6 +45,8 @@ struct thermistor
 static struct thermistor s_thermistor = {4126.0f,298.15f,10000.0f};					// GT 10K
 //static struct thermistor s_thermistor = {4090.0f,298.15f,47000.0f};	// Vishay 10K
 
+static uint16_t s_thermistorReading; // ADC reading from the last update
+
 /*
  * Private Functions
  */
@@ -90,29 +94,62 @@ static float thermistor_to_temperature(float data, int OutputUnit, float R_Balan
  * Public Functions
  */
 
-void TEMP_WriteTemperatureToBuffer(FixedLengthAccumulator * accum)
+void TEMP_UpdateTemperature(void)
+{
+  s_thermistorReading = analogRead(THERMISTOR_PIN);
+}
+
+uint16_t TEMP_GetReading(void)
+{
+  return s_thermistorReading;
+}
+
+/*
+ * TEMP_GetThermistorConstants
+ * Gets the B, T0, R0 and balance resistor values used for the temperature conversion
+ */
+void TEMP_GetThermistorConstants(float * b, float * t0, float * r0, float * balance)
+{
+  *b = s_thermistor.B;
+  *t0 = s_thermistor.T0;
+  *r0 = s_thermistor.R0;
+  *balance = THERMISTOR_BALANCE_OHMS;
+}
+
+/*
+ * TEMP_WriteTemperatureToBuffer
+ * Converts a thermistor ADC reading (from TEMP_GetReading) to celsius and writes it to the accumulator
+ */
+void TEMP_WriteTemperatureToBuffer(uint16_t reading, FixedLengthAccumulator * accum)
 {
   if (!accum) { return; }
 
-  float data = float(analogRead(THERMISTOR_PIN));
-  float tempC = thermistor_to_temperature(data, T_CELSIUS, 10000.0f, true);
-  
-  char tempCstr[6];  // A string buffer to hold the converted string
-  dtostrf(tempC, 2, 2, tempCstr);  // Convert the temperature value (double) into a string
+  // The thermistor curve needs float maths, but the result is printed as hundredths of a degree
+  float data = float(reading);
+  float tempC = thermistor_to_temperature(data, T_CELSIUS, THERMISTOR_BALANCE_OHMS, true);
 
-  accum->writeString(tempCstr);
+  uint16_t start = accum->length();
+  accum->writeFixed(FIXED_FromFloat(tempC, 2), 2);
 
   if(APP_InDebugMode())
   {
     Serial.print("Therm: ");
-    Serial.println(tempCstr);  
+    Serial.println(accum->c_str() + start);
   }
 }
 
 #else
 
-void TEMP_WriteTemperatureToBuffer(FixedLengthAccumulator * accum)
+void TEMP_UpdateTemperature(void) {}
+uint16_t TEMP_GetReading(void) { return 0; }
+void TEMP_GetThermistorConstants(float * b, float * t0, float * r0, float * balance)
+{
+	*b = *t0 = *r0 = *balance = 0.0f;
+}
+
+void TEMP_WriteTemperatureToBuffer(uint16_t reading, FixedLengthAccumulator * accum)
 {
+	(void)reading;
 	(void)accum;
 }
 
@@ -1,12 +1,17 @@
 #ifndef _TEMPERATURE_H_
 #define _TEMPERATURE_H_
 
+// Record fields (see fields.h)
 #if READ_TEMPERATURE == 1
-#define TEMPERATURE_HEADERS "Temp C, "
+#define TEMPERATURE_FIELDS(FIELD) \
+  FIELD(BINARY_FIELD_TEMPERATURE, "Temp C", 2, TEMP_UpdateTemperature, TEMP_GetReading(), TEMP_WriteTemperatureToBuffer)
 #else
-#define TEMPERATURE_HEADERS ""
+#define TEMPERATURE_FIELDS(FIELD)
 #endif
 
-void TEMP_WriteTemperatureToBuffer(FixedLengthAccumulator * accum);
+void TEMP_UpdateTemperature(void);
+uint16_t TEMP_GetReading(void);
+void TEMP_GetThermistorConstants(float * b, float * t0, float * r0, float * balance);
+void TEMP_WriteTemperatureToBuffer(uint16_t reading, FixedLengthAccumulator * accum);
 
 #endif
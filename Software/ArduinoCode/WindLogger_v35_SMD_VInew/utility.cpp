@@ -12,19 +12,7 @@
 
 /************ Application Libraries*****************************/
 #include "utility.h"
-
-/* 
- * Defines
- */
-
-#define MAX_STRING 130      // Sets the maximum length of string probably could be lower
-
-/* 
- * Private Variables
- */
-
-static char s_progmemBuffer[MAX_STRING];  // A buffer to hold the string when pulled from program memory
-
+#include "fixed_point.h"
 
 /* 
  * Public Functions
@@ -45,21 +33,6 @@ byte DecToBcd(byte value)
   return (value / 10 * 16 + value % 10);
 }
 
-/***************************************************
- *  Name:        PStringToRAM
- *
- *  Returns:     Pointer to local string buffer
- *
- *  Parameters:  Pointer to string in PROGMEM.
- *
- *  Description: Copies string from flash to RAM and returns pointer to the RAM copy
- *
- ***************************************************/
-char* PStringToRAM(const char* str) {
-	strcpy_P(s_progmemBuffer, str);
-	return s_progmemBuffer;
-}
-
 /* FixedLengthAccumulator class 
  * Copied from Datalogger project (https://github.com/re-innovation/DataLogger)
  */
@@ -96,12 +69,31 @@ bool FixedLengthAccumulator::writeChar(char c)
     if (m_buffer && m_writeIndex < m_maxLength)
     {
         m_buffer[m_writeIndex++] = c;
-        m_buffer[m_writeIndex] = '\0';
         return true;
     }
     return false;
 }
 
+/*
+ * FixedLengthAccumulator::write
+ *
+ * Copies length chars from s, or as many as will fit
+ * Returns true if ALL of them were copied
+ */
+
+bool FixedLengthAccumulator::write(const char * s, uint16_t length)
+{
+    if (!s || !m_buffer) { return false; }
+
+    uint16_t space = m_maxLength - m_writeIndex;
+    uint16_t count = (length < space) ? length : space;
+
+    memcpy(&m_buffer[m_writeIndex], s, count);
+    m_writeIndex += count;
+
+    return (count == length);
+}
+
 /*
  * FixedLengthAccumulator::writeString
  *
@@ -113,14 +105,27 @@ bool FixedLengthAccumulator::writeChar(char c)
 bool FixedLengthAccumulator::writeString(const char * s)
 {
     if (!s) { return false; }
-    
-    while(*s && (m_writeIndex < m_maxLength))
-    {
-        m_buffer[m_writeIndex++] = *s++;
-        m_buffer[m_writeIndex] = '\0';
-    }
-    
-    return (*s == '\0');
+    return write(s, strlen(s));
+}
+
+/*
+ * FixedLengthAccumulator::writeString_P
+ *
+ * As per writeString, for a string in PROGMEM (copied straight from flash)
+ */
+
+bool FixedLengthAccumulator::writeString_P(const char * s)
+{
+    if (!s || !m_buffer) { return false; }
+
+    uint16_t length = strlen_P(s);
+    uint16_t space = m_maxLength - m_writeIndex;
+    uint16_t count = (length < space) ? length : space;
+
+    memcpy_P(&m_buffer[m_writeIndex], s, count);
+    m_writeIndex += count;
+
+    return (count == length);
 }
 
 /*
@@ -133,10 +138,53 @@ bool FixedLengthAccumulator::writeLine(const char * s)
 {
     bool success = true;
     success &= writeString(s);
-    success &= writeString("\r\n");
+    success &= write("\r\n", 2);
     return success;
 }
 
+/*
+ * FixedLengthAccumulator::writeFixed
+ *
+ * Writes value / 10^decimals (see fixed_point.h), straight into the buffer if there is room.
+ * Returns true if the whole number was written
+ */
+
+bool FixedLengthAccumulator::writeFixed(int32_t value, uint8_t decimals)
+{
+    if (!m_buffer) { return false; }
+
+    if ((m_maxLength - m_writeIndex) >= FIXED_MAX_LENGTH)
+    {
+        m_writeIndex += FIXED_Format(&m_buffer[m_writeIndex], value, decimals);
+        return true;
+    }
+
+    // Near the end of the buffer, write as much of the number as fits
+    char number[FIXED_MAX_LENGTH + 1];
+    return write(number, FIXED_Format(number, value, decimals));
+}
+
+/*
+ * FixedLengthAccumulator::writeUnsigned
+ *
+ * Writes value as a decimal integer, straight into the buffer if there is room.
+ * Returns true if the whole number was written
+ */
+
+bool FixedLengthAccumulator::writeUnsigned(uint32_t value)
+{
+    if (!m_buffer) { return false; }
+
+    if ((m_maxLength - m_writeIndex) >= FIXED_MAX_LENGTH)
+    {
+        m_writeIndex += FIXED_FormatUnsigned(&m_buffer[m_writeIndex], value, 0);
+        return true;
+    }
+
+    char number[FIXED_MAX_LENGTH + 1];
+    return write(number, FIXED_FormatUnsigned(number, value, 0));
+}
+
 /*
  * FixedLengthAccumulator::reset
  *
@@ -146,17 +194,18 @@ bool FixedLengthAccumulator::writeLine(const char * s)
 void FixedLengthAccumulator::reset(void)
 {
     m_writeIndex = 0;
-    m_buffer[m_writeIndex] = '\0';
 }
 
 /*
  * FixedLengthAccumulator::c_str
  *
- * Returns pointer to the actual buffer
+ * Terminates the string and returns pointer to the actual buffer.
+ * The writes do not terminate the string, so use this (not the buffer) when a C string is needed.
  */
 
 char * FixedLengthAccumulator::c_str(void)
 {
+    if (m_buffer) { m_buffer[m_writeIndex] = '\0'; }
     return m_buffer;
 }
 
@@ -214,7 +263,7 @@ uint16_t FixedLengthAccumulator::length(void)
 /*
  * FixedLengthAccumulator::remove
  *
- * Removes chars from the end of the buffer by placing a '\0' in the appropriate position
+ * Removes chars from the end of the buffer
  */
 
 void FixedLengthAccumulator::remove(uint32_t chars)
@@ -227,7 +276,5 @@ void FixedLengthAccumulator::remove(uint32_t chars)
     {
         m_writeIndex -= chars;
     }
-
-    m_buffer[m_writeIndex] = '\0';
 }
 
@@ -3,7 +3,9 @@
 
 // Converts a decimal to BCD (binary coded decimal)
 byte DecToBcd(byte value);
-char* PStringToRAM(const char* str);
+
+// Lets a string in PROGMEM be printed straight from flash (like the F() macro)
+#define FLASH_STRING(str) ((const __FlashStringHelper *)(str))
 
 
 /*
@@ -20,8 +22,12 @@ class FixedLengthAccumulator
         FixedLengthAccumulator(char * buffer, uint16_t length);
         ~FixedLengthAccumulator();
         bool writeChar(char c);
+        bool write(const char * s, uint16_t length);
         bool writeString(const char * s);
+        bool writeString_P(const char * s);
         bool writeLine(const char * s);
+        bool writeFixed(int32_t value, uint8_t decimals);
+        bool writeUnsigned(uint32_t value);
     
         void remove(uint32_t chars);
                 
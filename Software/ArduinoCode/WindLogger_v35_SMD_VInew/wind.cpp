@@ -8,6 +8,7 @@
  */
 
 #include <Arduino.h>
+#include <math.h>
 
 #define LIBCALL_ENABLEINTERRUPT
 #include <EnableInterrupt.h>
@@ -15,22 +16,157 @@
 #include "app.h"
 #include "eeprom_storage.h"
 #include "utility.h"
+#include "fixed_point.h"
 #include "wind.h"
 
+/*
+ * Defines and typedefs
+ */
+
+#define WIND_RING_SECONDS 8 // Seconds the tick interrupt can get ahead of WIND_UpdateStatistics (a power of 2)
+#define WIND_GUST_SECONDS 3 // The gust is the highest running mean over this many seconds (as WMO)
+
+// Running totals of the pulses counted in each second of a period.
+// Each second is at most 65535 pulses and a period is at most 65535 seconds (the sample time is 16 bits),
+// so sum fits in 32 bits and seconds x sum_squares and sum x sum fit in 64 bits.
+struct wind_statistics
+{
+	uint32_t sum;
+	uint64_t sum_squares;
+	uint16_t peak;               // Most pulses in one second
+	uint32_t gust;               // Most pulses in WIND_GUST_SECONDS consecutive seconds
+};
+
+#define WIND_TIMER_PRESCALER 1024 // Timer1 counts at F_CPU / 1024 (64us per tick at 16MHz, 32 bit timestamps wrap after 76 hours)
+#define WIND_TICKS_PER_1000_SECONDS (((uint64_t)F_CPU * 1000) / WIND_TIMER_PRESCALER)
+#define WIND_PERIOD_MAXIMUM 0xFFFFFFUL // The period results are written from 3 bytes
+#define WIND_EDGE_MAXIMUM_AGE 0x8000 // Timer1 overflows (38 hours) before the last edge is too old to time an interval from
+
+// Timer1 times of the pulse edges from one anemometer in one period
+struct wind_edges
+{
+	uint32_t first;              // The edge the intervals in this period are measured from
+	uint32_t last;               // The latest edge
+	uint32_t shortest;           // Shortest interval between edges in this period
+	uint32_t intervals;          // Intervals between edges in this period
+};
+
+#define WIND_BENCHMARK_PULSES 1000 // So the time for all of them in us is the time for one in ns
+
+// Everything the pulse interrupts count in one period, for both anemometers.
+// There are two banks: the pulse interrupts only update the live bank. At the end of a period,
+// WIND_StoreWindPulseCounts swaps the banks and then reads and clears the other one,
+// so the interrupts never have to be disabled to read the counts.
+struct wind_bank
+{
+	uint32_t pulses[2];
+#if WIND_DEBOUNCE == 1
+	uint16_t rejected[2];        // Pulses rejected by the lockout
+#endif
+#if READ_WIND_PERIODS == 1
+	struct wind_edges edges[2];
+#endif
+};
+
+#define WIND_VECTOR_ONE 16384 // Length of the unit vectors in the direction table (Q14)
+#define WIND_VECTOR_MAXIMUM_READINGS 0xFFFFUL // Keeps x and y within +/- 65535 x WIND_VECTOR_ONE (under 2^30)
+
+// Sums of the unit vectors of the vane readings in a period (x east, y north)
+struct wind_vector
+{
+	// The vane is read once a second, so the longest sample time (65535 s) is within WIND_VECTOR_MAXIMUM_READINGS.
+	// Any readings past it are left out of x and y, so they can't overflow.
+	int32_t x;
+	int32_t y;
+	uint32_t readings;
+#if (READ_WINDSPEED == 1) && (WIND_WEIGHTED_DIRECTION == 1)
+	int64_t weighted_x;          // Each reading weighted by the pulses since the last reading
+	int64_t weighted_y;
+	uint32_t weight;
+#endif
+};
+
 /* 
  * Private Variables
  */
 
 /********** Wind Direction Storage *************/
 #if READ_WIND_DIRECTION
-static char s_windDirection[3]; // Hold "N", "NE", "E" etc. strings
 static int s_windDirectionArray[] = {0,0,0,0,0,0,0,0};  //Holds count of each cardinal wind direction
+static uint8_t s_windDirectionIndex = 0; // Most frequent direction (0 = N, 1 = NE ... 7 = NW)
+
+#if WIND_VECTOR_DIRECTION == 1
+// Unit vector (x = sin, y = cos of the compass bearing) for each direction band (0 = N, 1 = NE ... 7 = NW)
+static const int16_t s_directionVectors[8][2] PROGMEM = {
+	{0, WIND_VECTOR_ONE}, {11585, 11585}, {WIND_VECTOR_ONE, 0}, {11585, -11585},
+	{0, -WIND_VECTOR_ONE}, {-11585, -11585}, {-WIND_VECTOR_ONE, 0}, {-11585, 11585}
+};
+
+static struct wind_vector s_vector;
+#if (READ_WINDSPEED == 1) && (WIND_WEIGHTED_DIRECTION == 1)
+static uint32_t s_vectorPulseBase = 0; // Anemometer 1 total at the last vane reading
+#endif
+
+// Results for the last period, in tenths of a degree (or WIND_NO_DEGREES)
+static uint16_t s_meanDirection = WIND_NO_DEGREES;
+static uint16_t s_directionSigma = WIND_NO_DEGREES;
+static uint16_t s_weightedDirection = WIND_NO_DEGREES;
+#endif
 #endif
 
 // Variables for the Pulse Counter
 #if READ_WINDSPEED
-static volatile long s_livePulseCounters[2] = {0, 0};  // This counts pulses from the flow sensor  - Needs to be long to hold number
-static volatile long s_pulseCountersOld[2] = {0, 0};  // This is storage for the old flow sensor - Needs to be long to hold number
+static volatile struct wind_bank s_banks[2];
+static volatile uint8_t s_liveBank = 0; // Only written by WIND_StoreWindPulseCounts
+static unsigned long s_pulseCountersOld[2] = {0, 0};  // Pulses counted in the last period
+
+#if (READ_WIND_STATISTICS == 1) || (SD_RAW_STREAM == 1) || ((READ_WIND_DIRECTION == 1) && (WIND_VECTOR_DIRECTION == 1) && (WIND_WEIGHTED_DIRECTION == 1))
+static volatile uint32_t s_pulseTotals[2] = {0, 0}; // Pulses counted since startup (wrapping), for the per-second counts
+#endif
+#if SD_RAW_STREAM == 1
+static uint32_t s_secondPulseBase[2] = {0, 0}; // Totals at the last WIND_GetSecondPulseCounts
+#endif
+
+#if WIND_DEBOUNCE == 1
+static volatile uint32_t s_lastPulse[2] = {0, 0}; // micros() at the last pulse counted
+static uint32_t s_lockout = WIND_DEFAULT_DEBOUNCE_MS * 1000UL; // us
+static uint8_t s_lockoutMs = WIND_DEFAULT_DEBOUNCE_MS;
+static uint16_t s_rejectedOld[2] = {0, 0}; // Pulses rejected in the last period
+#endif
+
+#if READ_WIND_STATISTICS == 1
+// Pulses in each second, latched by the tick interrupt and added to the statistics by the main loop
+static volatile uint16_t s_ring[WIND_RING_SECONDS][2];
+static volatile uint8_t s_ringHead = 0; // Only written by the tick interrupt
+static volatile uint8_t s_ringTail = 0; // Only written by WIND_UpdateStatistics
+static volatile bool s_ringOverrun = false; // Set by the tick interrupt when a second is lost
+static uint32_t s_tickBase[2] = {0, 0}; // Totals at the last tick
+
+static struct wind_statistics s_statistics[2];
+static uint32_t s_statisticSeconds = 0;
+static uint16_t s_window[2][WIND_GUST_SECONDS]; // The latest seconds, for the gust
+static uint32_t s_windowSum[2] = {0, 0};
+static uint8_t s_windowIndex = 0;
+static uint8_t s_windowSeconds = 0; // Consecutive seconds in the window (up to WIND_GUST_SECONDS)
+
+// Results for the last period
+static uint16_t s_peak[2] = {0, 0};
+static uint32_t s_gust[2] = {0, 0}; // Hundredths of a pulse per second
+static uint32_t s_deviation[2] = {0, 0}; // Hundredths of a pulse per second
+static uint16_t s_turbulence[2] = {0, 0}; // Thousandths
+#endif
+
+#if READ_WIND_PERIODS == 1
+static volatile uint16_t s_timerOverflows = 0; // Upper 16 bits of the Timer1 timestamps
+static volatile uint32_t s_lastEdge[2] = {0, 0}; // Time of the last pulse edge
+static volatile bool s_edgeSeen[2] = {false, false}; // An edge has been timed (recently enough to time from)
+static volatile uint16_t s_edgeAge[2] = {0, 0}; // Timer1 overflows since the last edge
+
+// Results for the last period
+static uint32_t s_frequency[2] = {0, 0}; // Thousandths of a pulse per second
+static uint32_t s_meanInterval[2] = {0, 0}; // Tenths of a millisecond
+static uint32_t s_minInterval[2] = {0, 0}; // Tenths of a millisecond
+#endif
 #endif
 
 static bool s_windwave_is_at_top_of_divider = false;
@@ -39,7 +175,194 @@ static bool s_windwave_is_at_top_of_divider = false;
  * Private Functions
  */
 
+#if (READ_WINDSPEED == 1) && (READ_WIND_PERIODS == 1)
+/*
+ * timerNow
+ * Returns the Timer1 count, extended to 32 bits by the overflow count.
+ * Called with interrupts disabled (from the pulse interrupts).
+ */
+static inline uint32_t timerNow(void)
+{
+	uint16_t count = TCNT1;
+	uint16_t overflows = s_timerOverflows;
+
+	// The timer has overflowed but the overflow interrupt hasn't run yet
+	if ((TIFR1 & _BV(TOV1)) && (count < 0x8000)) { overflows++; }
+
+	return ((uint32_t)overflows << 16) | count;
+}
+
+/*
+ * timeEdge
+ * Timestamps a pulse edge and adds the interval since the previous edge to edges
+ */
+static inline void timeEdge(volatile struct wind_edges * edges, uint8_t counter)
+{
+	uint32_t now = timerNow();
+
+	if (s_edgeSeen[counter])
+	{
+		uint32_t interval = now - s_lastEdge[counter];
+
+		// The first interval in a period starts at the last edge of an earlier period
+		if (edges->intervals == 0) { edges->first = s_lastEdge[counter]; }
+		if (interval < edges->shortest) { edges->shortest = interval; }
+		edges->intervals++;
+		edges->last = now;
+	}
+
+	s_edgeSeen[counter] = true;
+	s_edgeAge[counter] = 0;
+	s_lastEdge[counter] = now;
+}
+
+/*
+ * Timer1 overflow (every 4.2 seconds at 16MHz)
+ * After WIND_EDGE_MAXIMUM_AGE overflows without a pulse, the last edge is forgotten,
+ * because an interval of more than 76 hours would wrap the 32 bit timestamps
+ */
+ISR(TIMER1_OVF_vect)
+{
+	s_timerOverflows++;
+
+	for (uint8_t i = 0; i < 2; i++)
+	{
+		if (s_edgeAge[i] < WIND_EDGE_MAXIMUM_AGE)
+		{
+			s_edgeAge[i]++;
+		}
+		else
+		{
+			s_edgeSeen[i] = false;
+		}
+	}
+}
+
+/*
+ * ticksToTenthsOfMs
+ * Returns ticks / divisor Timer1 ticks as tenths of a millisecond (up to WIND_PERIOD_MAXIMUM)
+ */
+static uint32_t ticksToTenthsOfMs(uint32_t ticks, uint32_t divisor)
+{
+	uint64_t scale = WIND_TICKS_PER_1000_SECONDS * divisor;
+	uint64_t tenths = (((uint64_t)ticks * 10000000UL) + (scale / 2)) / scale;
+	return (tenths > WIND_PERIOD_MAXIMUM) ? WIND_PERIOD_MAXIMUM : (uint32_t)tenths;
+}
+
+/*
+ * finishPeriods
+ * Works out the pulse frequency and intervals for the period that has just ended
+ */
+static void finishPeriods(const volatile struct wind_edges * latched)
+{
+	for (uint8_t i = 0; i < 2; i++)
+	{
+		const volatile struct wind_edges * edges = &latched[i];
+
+		s_frequency[i] = 0;
+		s_meanInterval[i] = 0;
+		s_minInterval[i] = 0;
+
+		if (edges->intervals == 0) { continue; }
+
+		// The intervals run back to the last edge of an earlier period, so a few slow pulses still give a frequency
+		uint32_t span = edges->last - edges->first;
+		if (span)
+		{
+			uint64_t frequency = (((uint64_t)edges->intervals * WIND_TICKS_PER_1000_SECONDS) + (span / 2)) / span;
+			s_frequency[i] = (frequency > WIND_PERIOD_MAXIMUM) ? WIND_PERIOD_MAXIMUM : (uint32_t)frequency;
+		}
+		else
+		{
+			s_frequency[i] = WIND_PERIOD_MAXIMUM;
+		}
+		s_meanInterval[i] = ticksToTenthsOfMs(span, edges->intervals);
+		s_minInterval[i] = ticksToTenthsOfMs(edges->shortest, 1);
+	}
+}
+#endif
+
+#if (READ_WINDSPEED == 1) && (WIND_DEBOUNCE == 1)
+/*
+ * acceptPulse
+ * Returns false if the pulse is within the lockout time
+ * of the last pulse accepted. Called from the pulse interrupts, so it only does one micros()
+ * read and a 32 bit compare (see WIND_PrintDebounce for the time it takes).
+ */
+static inline bool acceptPulse(volatile uint32_t * last)
+{
+	uint32_t now = micros();
+
+	if ((now - *last) < s_lockout) { return false; }
+
+	*last = now;
+	return true;
+}
+#endif
+
 #if READ_WINDSPEED == 1
+/*
+ * readCounter
+ * Returns a 32 bit value that the pulse interrupts update, without disabling them.
+ * An interrupt between the byte reads can tear the value, so it is read until two reads agree.
+ */
+static uint32_t readCounter(const volatile uint32_t * counter)
+{
+	uint32_t value;
+	do
+	{
+		value = *counter;
+	} while (value != *counter);
+	return value;
+}
+
+/*
+ * clearBank
+ * Clears a bank of counts that the pulse interrupts are not using, ready for it to be swapped in
+ */
+static void clearBank(uint8_t index)
+{
+	volatile struct wind_bank * bank = &s_banks[index];
+
+	for (uint8_t i = 0; i < 2; i++)
+	{
+		bank->pulses[i] = 0;
+#if WIND_DEBOUNCE == 1
+		bank->rejected[i] = 0;
+#endif
+#if READ_WIND_PERIODS == 1
+		bank->edges[i].intervals = 0;
+		bank->edges[i].shortest = 0xFFFFFFFF;
+#endif
+	}
+}
+
+/*
+ * countPulse
+ * Counts a pulse from an anemometer in the live bank. Called from the pulse interrupts.
+ */
+static inline void countPulse(uint8_t counter)
+{
+	volatile struct wind_bank * bank = &s_banks[s_liveBank];
+
+#if WIND_DEBOUNCE == 1
+	// Ignore switch bounce and noise
+	if (!acceptPulse(&s_lastPulse[counter]))
+	{
+		bank->rejected[counter]++;
+		return;
+	}
+#endif
+
+	bank->pulses[counter]++;
+#if (READ_WIND_STATISTICS == 1) || (SD_RAW_STREAM == 1) || ((READ_WIND_DIRECTION == 1) && (WIND_VECTOR_DIRECTION == 1) && (WIND_WEIGHTED_DIRECTION == 1))
+	s_pulseTotals[counter]++;
+#endif
+#if READ_WIND_PERIODS == 1
+	timeEdge(&bank->edges[counter], counter);
+#endif
+}
+
 /***************************************************
  *  Name:        pulse1
  *
@@ -54,8 +377,7 @@ static void pulse1(void)
 {
   // If the anemometer has spun around
   // Increment the pulse counter
-  s_livePulseCounters[0]++;
-  // ***TO DO**** Might need to debounce this
+  countPulse(0);
 }
 
 /***************************************************
@@ -72,8 +394,70 @@ static void pulse2(void)
 {
   // If the anemometer has spun around
   // Increment the pulse counter
-  s_livePulseCounters[1]++;
-  // ***TO DO**** Might need to debounce this
+  countPulse(1);
+}
+#endif
+
+#if (READ_WINDSPEED == 1) && (READ_WIND_STATISTICS == 1)
+/*
+ * roundedSqrt
+ * Returns the square root of value, rounded to the nearest integer
+ */
+static uint32_t roundedSqrt(uint64_t value)
+{
+	uint32_t root = FIXED_Sqrt(value);
+	if (((uint64_t)root * root) + root < value) { root++; }
+	return root;
+}
+
+/*
+ * scaledQuotient
+ * Returns value * scale / div (rounded down) without multiplying value up first.
+ * There is no overflow as long as (value / div) * scale and div * scale fit in 64 bits.
+ */
+static uint64_t scaledQuotient(uint64_t value, uint32_t scale, uint32_t div)
+{
+	return ((value / div) * scale) + (((value % div) * scale) / div);
+}
+
+/*
+ * finishStatistics
+ * Works out the statistics for the period that has just ended and starts the next one
+ */
+static void finishStatistics(void)
+{
+	// Seconds already latched belong to the period that has ended
+	WIND_UpdateStatistics();
+
+	for (uint8_t i = 0; i < 2; i++)
+	{
+		struct wind_statistics * stats = &s_statistics[i];
+		uint32_t seconds = s_statisticSeconds;
+
+		s_peak[i] = stats->peak;
+		s_gust[i] = FIXED_MulDiv(stats->gust, 100, WIND_GUST_SECONDS);
+		s_deviation[i] = 0;
+		s_turbulence[i] = 0;
+
+		if (seconds)
+		{
+			// seconds^2 x variance
+			uint64_t spread = (seconds * stats->sum_squares) - ((uint64_t)stats->sum * stats->sum);
+
+			// Standard deviation in hundredths (the root of 10000 x variance)
+			s_deviation[i] = roundedSqrt(scaledQuotient(spread, 10000, seconds) / seconds);
+
+			// Standard deviation / mean, in thousandths (the root of 1000000 x spread / sum^2)
+			if (stats->sum)
+			{
+				uint32_t turbulence = roundedSqrt(scaledQuotient(spread, 1000000, stats->sum) / stats->sum);
+				s_turbulence[i] = (turbulence > 0xFFFF) ? 0xFFFF : (uint16_t)turbulence;
+			}
+		}
+	}
+
+	memset(s_statistics, 0, sizeof(s_statistics));
+	s_statisticSeconds = 0;
 }
 #endif
 
@@ -89,6 +473,15 @@ static void pulse2(void)
  */
 void WIND_SetupWindPulseInterrupts()
 {
+#if READ_WIND_PERIODS == 1
+	// Timer1 free-runs to timestamp the pulses (normal mode, the overflow interrupt extends it to 32 bits)
+	TCCR1A = 0;
+	TCCR1B = _BV(CS12) | _BV(CS10);
+	TIMSK1 = _BV(TOIE1);
+#endif
+	clearBank(0);
+	clearBank(1);
+
 	pinMode(ANEMOMETER1, INPUT); 
 	digitalWrite(ANEMOMETER1, HIGH);
 	enableInterrupt(ANEMOMETER1, &pulse1, FALLING);
@@ -97,59 +490,287 @@ void WIND_SetupWindPulseInterrupts()
 	enableInterrupt(ANEMOMETER2, &pulse2, FALLING); 
 }
 
-void WIND_WritePulseCountToBuffer(uint8_t counter, FixedLengthAccumulator * accum)
+/* 
+ * WIND_WritePulseCountToBuffer
+ * Writes a pulse count (from WIND_GetStoredPulseCount) to the accumulator
+ */
+void WIND_WritePulseCountToBuffer(unsigned long count, FixedLengthAccumulator * accum)
 {
 	if (!accum) { return; }
-	char temp[16];
+	accum->writeUnsigned(count);
+}
+
+/* 
+ * WIND_GetStoredPulseCount
+ * Returns the pulse count stored at the end of the last period
+ */
+unsigned long WIND_GetStoredPulseCount(uint8_t counter)
+{
+	return (counter < 2) ? s_pulseCountersOld[counter] : 0;
+}
+
+/* 
+ * WIND_GetLivePulseCount
+ * Called by application to get the live pulse count
+ */
+long WIND_GetLivePulseCount(uint8_t counter)
+{
+	return (counter < 2) ? (long)readCounter(&s_banks[s_liveBank].pulses[counter]) : 0;
+}
+
 
-	if (counter < 2)
+/* 
+ * WIND_StoreWindPulseCounts
+ * Saves the counts for the period that has ended and starts counting the next period,
+ * by swapping the banks of counts
+ */
+void WIND_StoreWindPulseCounts()
+{
+	// A pulse interrupt before this (single byte) write counts in the old bank, and one after it counts
+	// in the new bank. Interrupts can't run in the middle of each other, so once the write is done
+	// nothing else touches the old bank, and it can be read and cleared with interrupts enabled.
+	uint8_t old = s_liveBank;
+	s_liveBank = old ^ 1;
+
+	volatile struct wind_bank * bank = &s_banks[old];
+
+	s_pulseCountersOld[0] = bank->pulses[0];
+	s_pulseCountersOld[1] = bank->pulses[1];
+#if WIND_DEBOUNCE == 1
+	s_rejectedOld[0] = bank->rejected[0];
+	s_rejectedOld[1] = bank->rejected[1];
+#endif
+
+#if READ_WIND_STATISTICS == 1
+	finishStatistics();
+#endif
+
+#if READ_WIND_PERIODS == 1
+	finishPeriods(bank->edges);
+#endif
+
+	clearBank(old);
+}
+
+#if READ_WIND_STATISTICS == 1
+/* 
+ * WIND_SecondTick
+ * Latches the pulses counted by each anemometer in the last second into the ring.
+ * Called from the tick interrupt (so the pulse totals can be read directly), and kept short:
+ * the statistics are worked out later by WIND_UpdateStatistics.
+ */
+void WIND_SecondTick()
+{
+	uint16_t counts[2];
+
+	for (uint8_t i = 0; i < 2; i++)
 	{
-		(void)ltoa(s_pulseCountersOld[counter], temp, 10);
-		accum->writeString(temp);
+		uint32_t total = s_pulseTotals[i];
+		uint32_t count = total - s_tickBase[i];
+		s_tickBase[i] = total;
+		counts[i] = (count > 0xFFFF) ? 0xFFFF : (uint16_t)count;
 	}
-	else
+
+	uint8_t head = s_ringHead;
+	if ((uint8_t)(head - s_ringTail) >= WIND_RING_SECONDS)
 	{
-		accum->writeString("??");
+		s_ringOverrun = true;
+		return;
 	}
+
+	s_ring[head % WIND_RING_SECONDS][0] = counts[0];
+	s_ring[head % WIND_RING_SECONDS][1] = counts[1];
+	s_ringHead = head + 1;
 }
 
 /* 
- * WIND_GetLivePulseCount
- * Called by application to get the live pulse count
+ * WIND_UpdateStatistics
+ * Adds the seconds latched by the tick interrupt to the statistics for the period.
+ * Called from the main loop (which runs at least once a second).
  */
-long WIND_GetLivePulseCount(uint8_t counter)
+void WIND_UpdateStatistics()
 {
-	long count;
+	if (s_ringOverrun)
+	{
+		// Seconds were lost, so the gust window starts again
+		s_ringOverrun = false;
+		s_windowSeconds = 0;
+		s_windowSum[0] = s_windowSum[1] = 0;
+		memset(s_window, 0, sizeof(s_window));
+	}
 
-	switch(counter)
+	while (s_ringTail != s_ringHead)
 	{
-		case 0:
-			count = s_livePulseCounters[0];
-			break;
-		case 1:
-			count = s_livePulseCounters[1];
-			break;
-		default:
-			count = 0;
-			break;
+		uint8_t slot = s_ringTail % WIND_RING_SECONDS;
+
+		if (s_windowSeconds < WIND_GUST_SECONDS) { s_windowSeconds++; }
+
+		for (uint8_t i = 0; i < 2; i++)
+		{
+			struct wind_statistics * stats = &s_statistics[i];
+			uint16_t count = s_ring[slot][i];
+
+			stats->sum += count;
+			stats->sum_squares += (uint32_t)count * count;
+			if (count > stats->peak) { stats->peak = count; }
+
+			// Running total over the last WIND_GUST_SECONDS seconds (which may be in the previous period)
+			s_windowSum[i] += count;
+			s_windowSum[i] -= s_window[i][s_windowIndex];
+			s_window[i][s_windowIndex] = count;
+			if ((s_windowSeconds == WIND_GUST_SECONDS) && (s_windowSum[i] > stats->gust)) { stats->gust = s_windowSum[i]; }
+		}
+
+		s_windowIndex = (s_windowIndex + 1) % WIND_GUST_SECONDS;
+		s_statisticSeconds++;
+		s_ringTail++;
 	}
+}
 
-	return count;
+/* 
+ * WIND_GetPeakCount, WIND_GetGust, WIND_GetDeviation, WIND_GetTurbulence
+ * Return the statistics of the per-second pulse counts for the last period:
+ * the most pulses in one second, the highest 3 second mean and the standard deviation
+ * (hundredths of a pulse per second) and the turbulence intensity (standard deviation / mean, in thousandths)
+ */
+uint16_t WIND_GetPeakCount(uint8_t counter) { return (counter < 2) ? s_peak[counter] : 0; }
+uint32_t WIND_GetGust(uint8_t counter) { return (counter < 2) ? s_gust[counter] : 0; }
+uint32_t WIND_GetDeviation(uint8_t counter) { return (counter < 2) ? s_deviation[counter] : 0; }
+uint16_t WIND_GetTurbulence(uint8_t counter) { return (counter < 2) ? s_turbulence[counter] : 0; }
+
+/* 
+ * WIND_WriteHundredthsToBuffer, WIND_WriteTurbulenceToBuffer
+ * Write a statistic (from the functions above) to the accumulator
+ */
+void WIND_WriteHundredthsToBuffer(unsigned long value, FixedLengthAccumulator * accum)
+{
+	if (!accum) { return; }
+	accum->writeFixed(value, 2);
 }
 
+void WIND_WriteTurbulenceToBuffer(unsigned long value, FixedLengthAccumulator * accum)
+{
+	if (!accum) { return; }
+	accum->writeFixed(value, 3);
+}
+#else
+void WIND_SecondTick() {}
+void WIND_UpdateStatistics() {}
+#endif
 
+#if WIND_DEBOUNCE == 1
 /* 
- * WIND_StoreWindPulseCounts
- * Saves the latest pulse counts and resets the live counts
+ * WIND_SetDebounce
+ * Sets the lockout time after each pulse, in ms (0 counts every pulse).
+ * Unprogrammed EEPROM (0xFF) gives the default.
  */
-void WIND_StoreWindPulseCounts()
+void WIND_SetDebounce(uint8_t ms)
 {
-	s_pulseCountersOld[0] = s_livePulseCounters[0];
-    s_pulseCountersOld[1] = s_livePulseCounters[1];
-    s_livePulseCounters[0] = 0;
-    s_livePulseCounters[1] = 0;
+	if (ms == 0xFF) { ms = WIND_DEFAULT_DEBOUNCE_MS; }
+	if (ms > WIND_MAX_DEBOUNCE_MS) { ms = WIND_MAX_DEBOUNCE_MS; }
+
+	s_lockoutMs = ms;
+	noInterrupts();
+	s_lockout = ms * 1000UL;
+	interrupts();
 }
 
+uint8_t WIND_GetDebounce() { return s_lockoutMs; }
+
+/* 
+ * WIND_GetRejectedCount
+ * Returns the number of pulses rejected in the last period
+ */
+uint16_t WIND_GetRejectedCount(uint8_t counter) { return (counter < 2) ? s_rejectedOld[counter] : 0; }
+
+/* 
+ * WIND_LockoutIsRunning
+ * Returns true until the lockout after the last pulses has finished.
+ * micros() stops in sleep, so the logger only sleeps with Timer0 left on while this is true (see sleep.cpp).
+ * Called with interrupts disabled.
+ */
+bool WIND_LockoutIsRunning()
+{
+	uint32_t now = micros();
+	return ((now - s_lastPulse[0]) < s_lockout) || ((now - s_lastPulse[1]) < s_lockout);
+}
+
+const char s_pstr_debounce[] PROGMEM = "Debounce ms:";
+const char s_pstr_pulse_check[] PROGMEM = "Pulse check ns:";
+
+/* 
+ * WIND_PrintDebounce
+ * Prints the lockout time, and an estimate of the time the pulse check adds to each pulse interrupt.
+ * The check is timed from the main loop, so the loop overhead and any interrupts that run are included.
+ */
+void WIND_PrintDebounce()
+{
+	volatile uint32_t bench = 0;
+
+	uint32_t start = micros();
+	for (uint16_t i = 0; i < WIND_BENCHMARK_PULSES; i++)
+	{
+		(void)acceptPulse(&bench);
+	}
+	uint32_t elapsed = micros() - start;
+
+	Serial.print(FLASH_STRING(s_pstr_debounce));
+	Serial.println(s_lockoutMs);
+	Serial.print(FLASH_STRING(s_pstr_pulse_check));
+	Serial.println(elapsed);
+}
+#else
+void WIND_SetDebounce(uint8_t ms) { (void)ms; }
+uint8_t WIND_GetDebounce() { return 0; }
+uint16_t WIND_GetRejectedCount(uint8_t counter) { (void)counter; return 0; }
+bool WIND_LockoutIsRunning() { return false; }
+void WIND_PrintDebounce() {}
+#endif
+
+#if READ_WIND_PERIODS == 1
+/* 
+ * WIND_GetFrequency, WIND_GetMeanInterval, WIND_GetMinInterval
+ * Return the timed pulses for the last period: the mean frequency (thousandths of a pulse per second)
+ * and the mean and shortest intervals between pulses (tenths of a millisecond). All 0 if there were no pulses.
+ */
+uint32_t WIND_GetFrequency(uint8_t counter) { return (counter < 2) ? s_frequency[counter] : 0; }
+uint32_t WIND_GetMeanInterval(uint8_t counter) { return (counter < 2) ? s_meanInterval[counter] : 0; }
+uint32_t WIND_GetMinInterval(uint8_t counter) { return (counter < 2) ? s_minInterval[counter] : 0; }
+
+/* 
+ * WIND_WriteFrequencyToBuffer, WIND_WriteIntervalToBuffer
+ * Write a frequency or interval (from the functions above) to the accumulator
+ */
+void WIND_WriteFrequencyToBuffer(unsigned long value, FixedLengthAccumulator * accum)
+{
+	if (!accum) { return; }
+	accum->writeFixed(value, 3);
+}
+
+void WIND_WriteIntervalToBuffer(unsigned long value, FixedLengthAccumulator * accum)
+{
+	if (!accum) { return; }
+	accum->writeFixed(value, 1);
+}
+#endif
+
+#if SD_RAW_STREAM == 1
+/* 
+ * WIND_GetSecondPulseCounts
+ * Fills counts with the pulses from each anemometer since the last call (up to 255)
+ */
+void WIND_GetSecondPulseCounts(uint8_t * counts)
+{
+	for (uint8_t i = 0; i < 2; i++)
+	{
+		uint32_t total = readCounter(&s_pulseTotals[i]);
+		uint32_t count = total - s_secondPulseBase[i];
+		counts[i] = (count > 255) ? 255 : (uint8_t)count;
+		s_secondPulseBase[i] = total;
+	}
+}
+#endif
+
 /* 
  * WIND_Debug
  * Output debugging strings if in debug mode
@@ -168,15 +789,101 @@ void WIND_Debug()
 
 #else
 void WIND_SetupWindPulseInterrupts() {}
-void WIND_WritePulseCountToBuffer(uint8_t counter, FixedLengthAccumulator * accum)
+void WIND_WritePulseCountToBuffer(unsigned long count, FixedLengthAccumulator * accum)
 {
-	(void)counter;
+	(void)count;
 	(void)accum;
 }
+unsigned long WIND_GetStoredPulseCount(uint8_t counter) { (void)counter; return 0; }
 long WIND_GetLivePulseCount(uint8_t counter) { (void)counter; return 0;}
 void WIND_StoreWindPulseCounts() {}
+void WIND_GetSecondPulseCounts(uint8_t * counts) { counts[0] = counts[1] = 0; }
 void WIND_Debug() {};
+void WIND_SecondTick() {}
+void WIND_UpdateStatistics() {}
+void WIND_SetDebounce(uint8_t ms) { (void)ms; }
+uint8_t WIND_GetDebounce() { return 0; }
+uint16_t WIND_GetRejectedCount(uint8_t counter) { (void)counter; return 0; }
+bool WIND_LockoutIsRunning() { return false; }
+void WIND_PrintDebounce() {}
+
+#endif
+
+#if (READ_WIND_DIRECTION == 1) && (WIND_VECTOR_DIRECTION == 1)
+/*
+ * addDirectionVector
+ * Adds the unit vector for a direction band to the sums for the period
+ * (a table lookup and adds, so it is cheap enough for every vane reading)
+ */
+static void addDirectionVector(uint8_t direction)
+{
+	int16_t x = (int16_t)pgm_read_word(&s_directionVectors[direction][0]);
+	int16_t y = (int16_t)pgm_read_word(&s_directionVectors[direction][1]);
+
+	if (s_vector.readings < WIND_VECTOR_MAXIMUM_READINGS)
+	{
+		s_vector.x += x;
+		s_vector.y += y;
+		s_vector.readings++;
+	}
+
+#if (READ_WINDSPEED == 1) && (WIND_WEIGHTED_DIRECTION == 1)
+	uint32_t total = readCounter(&s_pulseTotals[0]);
+	uint32_t pulses = total - s_vectorPulseBase;
+	s_vectorPulseBase = total;
+
+	s_vector.weighted_x += (int64_t)pulses * x;
+	s_vector.weighted_y += (int64_t)pulses * y;
+	s_vector.weight += pulses;
+#endif
+}
+
+/*
+ * bearing
+ * Returns the compass bearing of a vector in tenths of a degree (0 to 3599)
+ */
+static uint16_t bearing(float x, float y)
+{
+	int32_t tenths = FIXED_FromFloat(atan2(x, y) * (180.0f / (float)M_PI), 1);
+	if (tenths < 0) { tenths += 3600; }
+	return (tenths >= 3600) ? 0 : (uint16_t)tenths;
+}
+
+/*
+ * finishVector
+ * Works out the mean direction and the Yamartino standard deviation for the period that has just ended
+ * and starts the next one. This is the only float maths, once per period.
+ */
+static void finishVector(void)
+{
+	s_meanDirection = WIND_NO_DEGREES;
+	s_directionSigma = WIND_NO_DEGREES;
+	s_weightedDirection = WIND_NO_DEGREES;
+
+	if (s_vector.readings)
+	{
+		float scale = (float)WIND_VECTOR_ONE * (float)s_vector.readings;
+		float x = (float)s_vector.x / scale;
+		float y = (float)s_vector.y / scale;
+
+		s_meanDirection = bearing(x, y);
+
+		// Yamartino: sigma = asin(e) x (1 + (2 / sqrt(3) - 1) x e^3), where e = sqrt(1 - (mean x^2 + mean y^2))
+		float length_squared = (x * x) + (y * y);
+		float e = (length_squared < 1.0f) ? sqrt(1.0f - length_squared) : 0.0f;
+		float sigma = asin(e) * (1.0f + (0.1547005f * e * e * e));
+		s_directionSigma = (uint16_t)FIXED_FromFloat(sigma * (180.0f / (float)M_PI), 1);
+	}
+
+#if (READ_WINDSPEED == 1) && (WIND_WEIGHTED_DIRECTION == 1)
+	if (s_vector.weight)
+	{
+		s_weightedDirection = bearing((float)s_vector.weighted_x, (float)s_vector.weighted_y);
+	}
+#endif
 
+	memset(&s_vector, 0, sizeof(s_vector));
+}
 #endif
 
 #if READ_WIND_DIRECTION == 1
@@ -208,9 +915,11 @@ void WIND_SetWindvanePosition(bool windwave_is_at_top_of_divider)
 // The value will be 1024 - vane integer reading
 
 // This means we can 'band' the data into 8 bands
+// Returns the band (0 = N, 1 = NE ... 7 = NW), or WIND_NO_DIRECTION for an error reading
 
-void WIND_ConvertWindDirection(int reading)
+uint8_t WIND_ConvertWindDirection(int reading)
 {
+	uint8_t direction = WIND_NO_DIRECTION;
 
 	if (s_windwave_is_at_top_of_divider)
 	{
@@ -219,40 +928,47 @@ void WIND_ConvertWindDirection(int reading)
 	
 	if(reading>0&&reading<100)
 	{
-		s_windDirectionArray[6]++;
+		direction = 6;
 	}
 	else if(reading>100&&reading<200)
 	{
-		s_windDirectionArray[7]++;
+		direction = 7;
 	}
 	else if(reading>200&&reading<350)
 	{
-		s_windDirectionArray[0]++; 
+		direction = 0; 
 	}
 	else if(reading>350&&reading<450)
 	{
-		s_windDirectionArray[5]++;
+		direction = 5;
 	}  
 	else if(reading>450&&reading<650)
 	{
-		s_windDirectionArray[1]++;
+		direction = 1;
 	}  
 	else if(reading>650&&reading<800)
 	{
-		s_windDirectionArray[4]++;
+		direction = 4;
 	}
 	else if(reading>800&&reading<900)
 	{
-		s_windDirectionArray[3]++;
+		direction = 3;
 	}
 	else if(reading>900&&reading<1024)
 	{
-		s_windDirectionArray[2]++;
+		direction = 2;
 	}
 	else
 	{
 	  // This is an error reading
+	  return direction;
 	}
+
+	s_windDirectionArray[direction]++;
+#if WIND_VECTOR_DIRECTION == 1
+	addDirectionVector(direction);
+#endif
+	return direction;
 }
 
 void WIND_AnalyseWindDirection()
@@ -273,57 +989,102 @@ void WIND_AnalyseWindDirection()
 	}
  	// Serial.println(maxIndex);  Testing
 	
-	// Clear the wind direction string and fill based on maxIndex	
-	s_windDirection[0] = s_windDirection[1] = s_windDirection[2] = '\0';  
- 	switch(maxIndex)
+	s_windDirectionIndex = maxIndex;
+
+	for(int i=0;i<8;i++)
+	{
+		//Resets the wind direction array
+		s_windDirectionArray[i]=0;
+	}
+
+#if WIND_VECTOR_DIRECTION == 1
+	finishVector();
+#endif
+}
+
+/* 
+ * WIND_WriteDirectionToBuffer
+ * Writes a direction index (from WIND_GetDirectionIndex) to the accumulator as "N", "NE", "E" etc.
+ */
+void WIND_WriteDirectionToBuffer(uint8_t index, FixedLengthAccumulator * accum)
+{
+	if (!accum) { return; }
+
+	char windDirection[3]; // Hold "N", "NE", "E" etc. strings
+
+	// Clear the wind direction string and fill based on index	
+	windDirection[0] = windDirection[1] = windDirection[2] = '\0';  
+ 	switch(index)
 	{
 		case 0:
-			s_windDirection[0] = 'N';
+			windDirection[0] = 'N';
 			break;
 		case 1:
-			s_windDirection[0] = 'N';
-			s_windDirection[1] = 'E';
+			windDirection[0] = 'N';
+			windDirection[1] = 'E';
 			break;    
 		case 2:
-			s_windDirection[0] = 'E';
+			windDirection[0] = 'E';
 			break;  
 		case 3:
-			s_windDirection[0] = 'S';
-			s_windDirection[1] = 'E';
+			windDirection[0] = 'S';
+			windDirection[1] = 'E';
 			break;
 		case 4:
-			s_windDirection[0] = 'S';
+			windDirection[0] = 'S';
 			break;  
 		case 5:
-			s_windDirection[0] = 'S';
-			s_windDirection[1] = 'W';
+			windDirection[0] = 'S';
+			windDirection[1] = 'W';
 			break;
 		case 6:
-			s_windDirection[0] = 'W';
+			windDirection[0] = 'W';
 			break;
 		case 7:
-			s_windDirection[0] = 'N';
-			s_windDirection[1] = 'W';
+			windDirection[0] = 'N';
+			windDirection[1] = 'W';
 			break;
 	}
 
-	for(int i=0;i<8;i++)
-	{
-		//Resets the wind direction array
-		s_windDirectionArray[i]=0;
-	}
+	accum->writeString(windDirection);
+}
+
+/* 
+ * WIND_GetDirectionIndex
+ * Returns the most frequent direction from the last period (0 = N, 1 = NE ... 7 = NW)
+ */
+uint8_t WIND_GetDirectionIndex()
+{
+	return s_windDirectionIndex;
 }
 
-void WIND_WriteDirectionToBuffer(FixedLengthAccumulator * accum)
+#if WIND_VECTOR_DIRECTION == 1
+/* 
+ * WIND_GetMeanDirection, WIND_GetDirectionSigma, WIND_GetWeightedDirection
+ * Return the vector mean direction, the Yamartino standard deviation of the direction and the
+ * speed-weighted mean direction for the last period, in tenths of a degree
+ * (WIND_NO_DEGREES if there were no vane readings, or no pulses for the weighted direction)
+ */
+uint16_t WIND_GetMeanDirection() { return s_meanDirection; }
+uint16_t WIND_GetDirectionSigma() { return s_directionSigma; }
+uint16_t WIND_GetWeightedDirection() { return s_weightedDirection; }
+
+/* 
+ * WIND_WriteDegreesToBuffer
+ * Writes a direction (from the functions above) to the accumulator in degrees, or nothing for WIND_NO_DEGREES
+ */
+void WIND_WriteDegreesToBuffer(unsigned long tenths, FixedLengthAccumulator * accum)
 {
-	if (!accum) { return; }
-	accum->writeString(s_windDirection);
+	if (!accum || (tenths == WIND_NO_DEGREES)) { return; }
+	accum->writeFixed(tenths, 1);
 }
+#endif
 
 #else
 
-void WIND_ConvertWindDirection(int reading) { (void)reading; }
+uint8_t WIND_ConvertWindDirection(int reading) { (void)reading; return WIND_NO_DIRECTION; }
 void WIND_AnalyseWindDirection() {}
-void WIND_WriteDirectionToBuffer(FixedLengthAccumulator * accum) { (void)accum; }
+void WIND_WriteDirectionToBuffer(uint8_t index, FixedLengthAccumulator * accum) { (void)index; (void)accum; }
+uint8_t WIND_GetDirectionIndex() { return 0; }
 
 #endif
@@ -6,16 +6,80 @@
 #define ANEMOMETER1 3  //   This is digital pin the pulse is attached to
 #define ANEMOMETER2 5  //   This is digital pin the pulse is attached to
 
+#define WIND_NO_DIRECTION 0xFF // Direction band for an invalid vane reading
+
+#define WIND_NO_DEGREES 0xFFFF // Vector direction when there were no vane readings
+
+#define WIND_DEFAULT_DEBOUNCE_MS 2 // Lockout after each pulse (up to 500 pulses per second)
+#define WIND_MAX_DEBOUNCE_MS 250
+
+// Record fields (see fields.h)
 #if READ_WINDSPEED == 1
-#define WINDSPEED_HEADERS "Wind 1, Wind 2, "
+#define WINDSPEED_FIELDS(FIELD) \
+  FIELD(BINARY_FIELD_WINDSPEED, "Wind 1", 3, WIND_StoreWindPulseCounts, WIND_GetStoredPulseCount(0), WIND_WritePulseCountToBuffer) \
+  FIELD(BINARY_FIELD_WINDSPEED, "Wind 2", 3, FIELD_NoUpdate, WIND_GetStoredPulseCount(1), WIND_WritePulseCountToBuffer)
+#define WINDSPEED_SUMMARY_HEADERS "Mean 1, Mean 2, Max 1, Max 2, "
+#else
+#define WINDSPEED_FIELDS(FIELD)
+#define WINDSPEED_SUMMARY_HEADERS ""
+#endif
+
+#if (READ_WINDSPEED == 1) && (READ_WIND_STATISTICS == 1)
+#define WIND_STATISTICS_FIELDS(FIELD) \
+  FIELD(BINARY_FIELD_WINDSPEED, "Peak 1", 2, FIELD_NoUpdate, WIND_GetPeakCount(0), WIND_WritePulseCountToBuffer) \
+  FIELD(BINARY_FIELD_WINDSPEED, "Gust 1", 3, FIELD_NoUpdate, WIND_GetGust(0), WIND_WriteHundredthsToBuffer) \
+  FIELD(BINARY_FIELD_WINDSPEED, "SD 1", 3, FIELD_NoUpdate, WIND_GetDeviation(0), WIND_WriteHundredthsToBuffer) \
+  FIELD(BINARY_FIELD_WINDSPEED, "TI 1", 2, FIELD_NoUpdate, WIND_GetTurbulence(0), WIND_WriteTurbulenceToBuffer) \
+  FIELD(BINARY_FIELD_WINDSPEED, "Peak 2", 2, FIELD_NoUpdate, WIND_GetPeakCount(1), WIND_WritePulseCountToBuffer) \
+  FIELD(BINARY_FIELD_WINDSPEED, "Gust 2", 3, FIELD_NoUpdate, WIND_GetGust(1), WIND_WriteHundredthsToBuffer) \
+  FIELD(BINARY_FIELD_WINDSPEED, "SD 2", 3, FIELD_NoUpdate, WIND_GetDeviation(1), WIND_WriteHundredthsToBuffer) \
+  FIELD(BINARY_FIELD_WINDSPEED, "TI 2", 2, FIELD_NoUpdate, WIND_GetTurbulence(1), WIND_WriteTurbulenceToBuffer)
+#else
+#define WIND_STATISTICS_FIELDS(FIELD)
+#endif
+
+#if (READ_WINDSPEED == 1) && (READ_WIND_PERIODS == 1)
+#define WIND_PERIOD_FIELDS(FIELD) \
+  FIELD(BINARY_FIELD_WINDSPEED, "Freq 1", 3, FIELD_NoUpdate, WIND_GetFrequency(0), WIND_WriteFrequencyToBuffer) \
+  FIELD(BINARY_FIELD_WINDSPEED, "Mean ms 1", 3, FIELD_NoUpdate, WIND_GetMeanInterval(0), WIND_WriteIntervalToBuffer) \
+  FIELD(BINARY_FIELD_WINDSPEED, "Min ms 1", 3, FIELD_NoUpdate, WIND_GetMinInterval(0), WIND_WriteIntervalToBuffer) \
+  FIELD(BINARY_FIELD_WINDSPEED, "Freq 2", 3, FIELD_NoUpdate, WIND_GetFrequency(1), WIND_WriteFrequencyToBuffer) \
+  FIELD(BINARY_FIELD_WINDSPEED, "Mean ms 2", 3, FIELD_NoUpdate, WIND_GetMeanInterval(1), WIND_WriteIntervalToBuffer) \
+  FIELD(BINARY_FIELD_WINDSPEED, "Min ms 2", 3, FIELD_NoUpdate, WIND_GetMinInterval(1), WIND_WriteIntervalToBuffer)
+#else
+#define WIND_PERIOD_FIELDS(FIELD)
+#endif
+
+#if (READ_WINDSPEED == 1) && (WIND_DEBOUNCE == 1)
+#define WIND_DEBOUNCE_FIELDS(FIELD) \
+  FIELD(BINARY_FIELD_WINDSPEED, "Rejected 1", 2, FIELD_NoUpdate, WIND_GetRejectedCount(0), WIND_WritePulseCountToBuffer) \
+  FIELD(BINARY_FIELD_WINDSPEED, "Rejected 2", 2, FIELD_NoUpdate, WIND_GetRejectedCount(1), WIND_WritePulseCountToBuffer)
 #else
-#define WINDSPEED_HEADERS ""
+#define WIND_DEBOUNCE_FIELDS(FIELD)
 #endif
 
 #if READ_WIND_DIRECTION == 1
-#define WIND_DIRECTION_HEADERS "Direction, "
+#define WIND_DIRECTION_FIELDS(FIELD) \
+  FIELD(BINARY_FIELD_WIND_DIRECTION, "Direction", 1, WIND_AnalyseWindDirection, WIND_GetDirectionIndex(), WIND_WriteDirectionToBuffer)
+#define WIND_DIRECTION_SUMMARY_HEADERS "Direction, "
+#else
+#define WIND_DIRECTION_FIELDS(FIELD)
+#define WIND_DIRECTION_SUMMARY_HEADERS ""
+#endif
+
+#if (READ_WIND_DIRECTION == 1) && (WIND_VECTOR_DIRECTION == 1)
+#if (READ_WINDSPEED == 1) && (WIND_WEIGHTED_DIRECTION == 1)
+#define WIND_WEIGHTED_FIELDS(FIELD) \
+  FIELD(BINARY_FIELD_WIND_DIRECTION, "Weighted dir", 2, FIELD_NoUpdate, WIND_GetWeightedDirection(), WIND_WriteDegreesToBuffer)
 #else
-#define WIND_DIRECTION_HEADERS ""
+#define WIND_WEIGHTED_FIELDS(FIELD)
+#endif
+#define WIND_VECTOR_FIELDS(FIELD) \
+  FIELD(BINARY_FIELD_WIND_DIRECTION, "Mean dir", 2, FIELD_NoUpdate, WIND_GetMeanDirection(), WIND_WriteDegreesToBuffer) \
+  FIELD(BINARY_FIELD_WIND_DIRECTION, "Sigma", 2, FIELD_NoUpdate, WIND_GetDirectionSigma(), WIND_WriteDegreesToBuffer) \
+  WIND_WEIGHTED_FIELDS(FIELD)
+#else
+#define WIND_VECTOR_FIELDS(FIELD)
 #endif
 
 // Public Functions
@@ -24,15 +88,43 @@ void WIND_SetupWindPulseInterrupts();
 
 void WIND_SetWindvanePosition(bool windwave_is_at_top_of_divider);
 
-void WIND_ConvertWindDirection(int reading);
+uint8_t WIND_ConvertWindDirection(int reading);
 void WIND_AnalyseWindDirection();
 
-void WIND_WritePulseCountToBuffer(uint8_t counter, FixedLengthAccumulator * accum);
-void WIND_WriteDirectionToBuffer(FixedLengthAccumulator * accum);
+void WIND_WritePulseCountToBuffer(unsigned long count, FixedLengthAccumulator * accum);
+void WIND_WriteDirectionToBuffer(uint8_t index, FixedLengthAccumulator * accum);
 
 long WIND_GetLivePulseCount(uint8_t counter);
+unsigned long WIND_GetStoredPulseCount(uint8_t counter);
+uint8_t WIND_GetDirectionIndex();
+uint16_t WIND_GetMeanDirection();
+uint16_t WIND_GetDirectionSigma();
+uint16_t WIND_GetWeightedDirection();
+void WIND_WriteDegreesToBuffer(unsigned long tenths, FixedLengthAccumulator * accum);
 
 void WIND_StoreWindPulseCounts();
+
+void WIND_SetDebounce(uint8_t ms);
+uint8_t WIND_GetDebounce();
+uint16_t WIND_GetRejectedCount(uint8_t counter);
+bool WIND_LockoutIsRunning();
+void WIND_PrintDebounce();
+void WIND_GetSecondPulseCounts(uint8_t * counts);
 void WIND_Debug();
 
+void WIND_SecondTick();
+void WIND_UpdateStatistics();
+uint16_t WIND_GetPeakCount(uint8_t counter);
+uint32_t WIND_GetGust(uint8_t counter);
+uint32_t WIND_GetDeviation(uint8_t counter);
+uint16_t WIND_GetTurbulence(uint8_t counter);
+void WIND_WriteHundredthsToBuffer(unsigned long value, FixedLengthAccumulator * accum);
+void WIND_WriteTurbulenceToBuffer(unsigned long value, FixedLengthAccumulator * accum);
+
+uint32_t WIND_GetFrequency(uint8_t counter);
+uint32_t WIND_GetMeanInterval(uint8_t counter);
+uint32_t WIND_GetMinInterval(uint8_t counter);
+void WIND_WriteFrequencyToBuffer(unsigned long value, FixedLengthAccumulator * accum);
+void WIND_WriteIntervalToBuffer(unsigned long value, FixedLengthAccumulator * accum);
+
 #endif
\ No newline at end of file
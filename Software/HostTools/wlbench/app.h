@@ -0,0 +1,14 @@
+/*
+ * app.h (wlbench)
+ *
+ * The switches delta_record.cpp is built with for the benchmark. This uses the same include
+ * guard as the logger's app.h, so that file is skipped when delta_record.cpp includes it.
+ */
+
+#ifndef _APP_H_
+#define _APP_H_
+
+#define SD_BINARY_FORMAT 1
+#define SD_DELTA_ENCODING 1
+
+#endif
@@ -0,0 +1,31 @@
+/*
+ * Arduino.h (host)
+ *
+ * Just enough of the Arduino core for wlbench to build utility.cpp on a PC.
+ * PROGMEM data is in RAM, so the _P functions are the plain ones.
+ */
+
+#ifndef _HOST_ARDUINO_H_
+#define _HOST_ARDUINO_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <stdio.h>
+
+typedef uint8_t byte;
+
+#define PROGMEM
+
+inline uint8_t pgm_read_byte(const void * p) { return *(const uint8_t *)p; }
+inline void * memcpy_P(void * d, const void * s, size_t n) { return memcpy(d, s, n); }
+inline size_t strlen_P(const char * s) { return strlen(s); }
+
+// avr-libc's dtostrf, as the usual host stand-in
+inline char * dtostrf(double value, signed char width, unsigned char precision, char * s)
+{
+	sprintf(s, "%*.*f", width, precision, value);
+	return s;
+}
+
+#endif
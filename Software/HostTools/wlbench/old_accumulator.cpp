@@ -0,0 +1,143 @@
+/*
+ * old_accumulator.cpp
+ *
+ * The FixedLengthAccumulator functions from utility.cpp before write(), writeString_P()
+ * and terminating only in c_str() were added (see old_accumulator.h)
+ */
+
+#include <stddef.h>
+
+#include "fixed_point.h"
+#include "old_accumulator.h"
+
+/*
+ * OldAccumulator::OldAccumulator
+ *
+ * Init the accumulator using a buffer and length of that buffer (INCLUDING space for terminating '\0')
+ */
+
+OldAccumulator::OldAccumulator(char * buffer, uint16_t length)
+{
+    m_buffer = buffer;
+    m_maxLength = length-1;
+    reset();
+}
+
+/*
+ * OldAccumulator::writeChar
+ *
+ * If there is space in the buffer, add the char to the string
+ * Returns true if char was written, false if not
+ */
+
+bool OldAccumulator::writeChar(char c)
+{
+    if (m_buffer && m_writeIndex < m_maxLength)
+    {
+        m_buffer[m_writeIndex++] = c;
+        m_buffer[m_writeIndex] = '\0';
+        return true;
+    }
+    return false;
+}
+
+/*
+ * OldAccumulator::writeString
+ *
+ * Copies chars from s until s is exhausted or the accumulator is full
+ * Therefore, this function may only copy a partial length of s
+ * Returns true if ALL of s was copied;
+ */
+
+bool OldAccumulator::writeString(const char * s)
+{
+    if (!s) { return false; }
+    
+    while(*s && (m_writeIndex < m_maxLength))
+    {
+        m_buffer[m_writeIndex++] = *s++;
+        m_buffer[m_writeIndex] = '\0';
+    }
+    
+    return (*s == '\0');
+}
+
+/*
+ * OldAccumulator::writeFixed
+ *
+ * Writes value / 10^decimals (see fixed_point.h), straight into the buffer if there is room.
+ * Returns true if the whole number was written
+ */
+
+bool OldAccumulator::writeFixed(int32_t value, uint8_t decimals)
+{
+    if (!m_buffer) { return false; }
+
+    if ((m_maxLength - m_writeIndex) >= FIXED_MAX_LENGTH)
+    {
+        m_writeIndex += FIXED_Format(&m_buffer[m_writeIndex], value, decimals);
+        return true;
+    }
+
+    // Near the end of the buffer, write as much of the number as fits
+    char number[FIXED_MAX_LENGTH + 1];
+    FIXED_Format(number, value, decimals);
+    return writeString(number);
+}
+
+/*
+ * OldAccumulator::writeUnsigned
+ *
+ * Writes value as a decimal integer, straight into the buffer if there is room.
+ * Returns true if the whole number was written
+ */
+
+bool OldAccumulator::writeUnsigned(uint32_t value)
+{
+    if (!m_buffer) { return false; }
+
+    if ((m_maxLength - m_writeIndex) >= FIXED_MAX_LENGTH)
+    {
+        m_writeIndex += FIXED_FormatUnsigned(&m_buffer[m_writeIndex], value, 0);
+        return true;
+    }
+
+    char number[FIXED_MAX_LENGTH + 1];
+    FIXED_FormatUnsigned(number, value, 0);
+    return writeString(number);
+}
+
+/*
+ * OldAccumulator::reset
+ *
+ * Makes the buffer appear to be an empty string
+ */
+
+void OldAccumulator::reset(void)
+{
+    m_writeIndex = 0;
+    m_buffer[m_writeIndex] = '\0';
+}
+
+/*
+ * OldAccumulator::c_str
+ *
+ * Returns pointer to the actual buffer
+ */
+
+char * OldAccumulator::c_str(void)
+{
+    return m_buffer;
+}
+
+/*
+ * OldAccumulator::length
+ *
+ * Returns the current length of the written buffer based on write index
+ */
+
+uint16_t OldAccumulator::length(void)
+{
+    return m_writeIndex;
+}
+
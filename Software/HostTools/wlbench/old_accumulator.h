@@ -0,0 +1,32 @@
+/*
+ * old_accumulator.h
+ *
+ * FixedLengthAccumulator (utility.h) as it was before write(), writeString_P() and terminating
+ * only in c_str(): every write stored a terminator after each char. Kept for wlbench to time against.
+ */
+
+#ifndef _OLD_ACCUMULATOR_H_
+#define _OLD_ACCUMULATOR_H_
+
+#include <stdint.h>
+
+class OldAccumulator
+{
+    public:
+        OldAccumulator(char * buffer, uint16_t length);
+        bool writeChar(char c);
+        bool writeString(const char * s);
+        bool writeFixed(int32_t value, uint8_t decimals);
+        bool writeUnsigned(uint32_t value);
+
+        void reset(void);
+        char * c_str(void);
+        uint16_t length(void);
+
+    private:
+        char * m_buffer;
+        uint16_t m_maxLength;
+        uint16_t m_writeIndex;
+};
+
+#endif
@@ -0,0 +1,413 @@
+/*
+ * wlbench.cpp
+ *
+ * Times the ways the logger can build the text of a record, on a PC.
+ *
+ * Usage: wlbench [passes]
+ *
+ * Each benchmark runs the old and the new code over every ADC reading (0 to 1023), passes times,
+ * and prints the mean time per conversion and how many readings give different text:
+ * - Value to text: the float/dtostrf conversions against the fixed_point.h ones
+ * - Record build: a CSV record with the default fields, built with the old FixedLengthAccumulator
+ *   (which terminated the string after every char) against the current one
+ * - Record encode: the same records as CSV text and as delta records (SD_DELTA_ENCODING), with the
+ *   mean bytes per record. The delta records are one second apart and each is encoded against the
+ *   one before (the first record is a keyframe).
+ *
+ * The old code is kept here as it was in the firmware; the new code is the firmware's own
+ * (utility.cpp, delta_record.cpp and fixed_point.h are built from the ArduinoCode folder;
+ * delta_record.cpp is included here, after the app.h next to this file).
+ *
+ * A PC has a floating point unit and the ATmega328P does not, so the float code is much
+ * cheaper here, relative to the integer code, than it is on the logger: these times show
+ * which way round the costs are, not the cycles on an AVR. Use the "YE" "Encode us:" figure
+ * on a logger for those.
+ *
+ * James Fowkes
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include <Arduino.h>
+
+#include "app.h"
+#include "delta_record.cpp"
+#include "utility.h"
+#include "fixed_point.h"
+#include "old_accumulator.h"
+
+/*
+ * Defines and typedefs
+ */
+
+#define BENCH_READINGS 1024
+#define BENCH_TEXT_LENGTH 32
+
+#define BENCH_R1 10000 // External voltage divider (the "R1"/"R2" settings)
+#define BENCH_R2 1000
+#define BENCH_CURRENT_OFFSET 512 // ADC reading at 0A
+#define BENCH_CURRENT_GAIN 60 // The "I gain" setting
+#define BENCH_CURRENT_SAMPLES 20 // The current reading is the sum of 20 ADC readings
+
+#define BENCH_DEVICE_ID "01"
+#define BENCH_FIELDS (BINARY_FIELD_WINDSPEED | BINARY_FIELD_WIND_DIRECTION | BINARY_FIELD_IRRADIANCE)
+
+typedef void (*conversion)(uint16_t reading, FixedLengthAccumulator * accum);
+
+struct benchmark
+{
+	const char * name;
+	conversion old_code;
+	conversion new_code;
+};
+
+/*
+ * Private Variables
+ */
+
+static volatile uint32_t s_sink = 0; // Stops the conversions being optimised away
+static char s_records[BENCH_READINGS][BINARY_MAX_RECORD_SIZE]; // Binary records with the values in buildRecord
+
+/*
+ * Private Functions
+ */
+
+/*
+ * nanoseconds
+ * Returns the monotonic clock in ns
+ */
+static uint64_t nanoseconds()
+{
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return ((uint64_t)now.tv_sec * 1000000000ULL) + (uint64_t)now.tv_nsec;
+}
+
+/*
+ * The conversions: the old float/dtostrf code, and the new integer code from the firmware
+ */
+
+static void batteryFloat(uint16_t reading, FixedLengthAccumulator * accum)
+{
+	char batteryVoltStr[6];
+	float batteryVoltage = float(reading)*(3.3f/1024.0f)*((470.0f+100.0f)/100.0f);
+	dtostrf(batteryVoltage, 2, 2, batteryVoltStr);
+	accum->writeString(batteryVoltStr);
+}
+
+static void batteryFixed(uint16_t reading, FixedLengthAccumulator * accum)
+{
+	accum->writeFixed(FIXED_MulDiv(reading, 1881, 1024), 2);
+}
+
+static void voltsFloat(uint16_t reading, FixedLengthAccumulator * accum)
+{
+	char externalVoltStr[8];
+	float externalVoltage = float(reading)*(3.3f/1023.0f)*((float(BENCH_R1)+float(BENCH_R2))/float(BENCH_R2));
+	dtostrf(externalVoltage, 2, 2, externalVoltStr);
+	accum->writeString(externalVoltStr);
+}
+
+static void voltsFixed(uint16_t reading, FixedLengthAccumulator * accum)
+{
+	uint32_t r1 = BENCH_R1;
+	uint32_t r2 = BENCH_R2;
+	accum->writeFixed(FIXED_MulDiv(reading * (r1 + r2), 110, 341 * r2), 2);
+}
+
+static void currentFloat(uint16_t reading, FixedLengthAccumulator * accum)
+{
+	char current1Str[8];
+	float offset = float(BENCH_CURRENT_OFFSET)*3.3f/1023.0f;
+	float current1 = float(reading * BENCH_CURRENT_SAMPLES)/20.0f;
+	current1 = (current1*3.3f/1023.0f) - offset;
+	current1 = current1*float(BENCH_CURRENT_GAIN);
+	dtostrf(current1, 2, 2, current1Str);
+	accum->writeString(current1Str);
+}
+
+static void currentFixed(uint16_t reading, FixedLengthAccumulator * accum)
+{
+	int32_t current1 = ((int32_t)(reading * BENCH_CURRENT_SAMPLES) - (20L * BENCH_CURRENT_OFFSET)) * BENCH_CURRENT_GAIN;
+	uint32_t centiamps = FIXED_MulDiv((current1 < 0) ? -current1 : current1, 11, 682);
+	accum->writeFixed((current1 < 0) ? -(int32_t)centiamps : (int32_t)centiamps, 2);
+}
+
+static const struct benchmark s_benchmarks[] = {
+	{"Battery volts", batteryFloat, batteryFixed},
+	{"External volts", voltsFloat, voltsFixed},
+	{"External current", currentFloat, currentFixed},
+};
+
+/*
+ * The record builds: encodeRecord in sd.cpp with the default fields (wind pulses 1 and 2,
+ * direction, irradiance and battery). The old code wrote its constant text with writeString.
+ * Both accumulators are built in their own files, so neither is inlined here.
+ */
+
+static void writeConstant(const char * s, uint16_t length, OldAccumulator * accum)
+{
+	(void)length;
+	accum->writeString(s);
+}
+
+static void writeConstant(const char * s, uint16_t length, FixedLengthAccumulator * accum)
+{
+	accum->write(s, length);
+}
+
+template <class Accumulator>
+static void write_two_digits(uint8_t value, Accumulator * accum)
+{
+	accum->writeChar('0' + (value / 10));
+	accum->writeChar('0' + (value % 10));
+}
+
+template <class Accumulator>
+static void buildRecord(uint16_t reading, Accumulator * accum)
+{
+	static const char * const directions[] = {"N", "NE", "E", "SE", "S", "SW", "W", "NW"};
+	const char comma = ',';
+
+	accum->writeChar(BENCH_DEVICE_ID[0]);
+	accum->writeChar(BENCH_DEVICE_ID[1]);
+	accum->writeChar(comma);
+	write_two_digits(1 + (reading % 28), accum);
+	accum->writeChar('-');
+	write_two_digits(1 + (reading % 12), accum);
+	writeConstant("-20", 3, accum);
+	write_two_digits(reading % 100, accum);
+	accum->writeChar(comma);
+	write_two_digits(reading % 24, accum);
+	accum->writeChar(':');
+	write_two_digits(reading % 60, accum);
+	accum->writeChar(':');
+	write_two_digits((reading * 7) % 60, accum);
+
+	accum->writeChar(comma);
+	accum->writeUnsigned(reading * 3UL);
+	accum->writeChar(comma);
+	accum->writeUnsigned(reading);
+	accum->writeChar(comma);
+	accum->writeString(directions[reading % 8]);
+	accum->writeChar(comma);
+	accum->writeFixed(((int32_t)reading * 200) + 4670, 2);
+	accum->writeChar(comma);
+	accum->writeFixed(FIXED_MulDiv(reading, 1881, 1024), 2);
+
+	writeConstant("\r\n", 2, accum);
+}
+
+/*
+ * timeRecord
+ * Returns the mean time in ns for one record build with the given accumulator
+ */
+template <class Accumulator>
+static double timeRecord(unsigned long passes)
+{
+	char text[BENCH_TEXT_LENGTH * 2];
+	Accumulator accum(text, sizeof(text));
+
+	uint64_t start = nanoseconds();
+	for (unsigned long pass = 0; pass < passes; pass++)
+	{
+		for (uint16_t reading = 0; reading < BENCH_READINGS; reading++)
+		{
+			accum.reset();
+			buildRecord(reading, &accum);
+			s_sink += accum.length();
+		}
+	}
+	uint64_t elapsed = nanoseconds() - start;
+
+	return (double)elapsed / ((double)passes * BENCH_READINGS);
+}
+
+/*
+ * timeConversion
+ * Returns the mean time in ns for one conversion, over every reading passes times
+ */
+static double timeConversion(conversion convert, unsigned long passes)
+{
+	char text[BENCH_TEXT_LENGTH];
+	FixedLengthAccumulator accum(text, sizeof(text));
+
+	uint64_t start = nanoseconds();
+	for (unsigned long pass = 0; pass < passes; pass++)
+	{
+		for (uint16_t reading = 0; reading < BENCH_READINGS; reading++)
+		{
+			accum.reset();
+			convert(reading, &accum);
+			s_sink += accum.length();
+		}
+	}
+	uint64_t elapsed = nanoseconds() - start;
+
+	return (double)elapsed / ((double)passes * BENCH_READINGS);
+}
+
+/*
+ * countDifferences
+ * Returns the number of readings for which the two conversions give different text
+ */
+static unsigned countDifferences(conversion a, conversion b)
+{
+	char text_a[BENCH_TEXT_LENGTH];
+	char text_b[BENCH_TEXT_LENGTH];
+	FixedLengthAccumulator accum_a(text_a, sizeof(text_a));
+	FixedLengthAccumulator accum_b(text_b, sizeof(text_b));
+	unsigned differences = 0;
+
+	for (uint16_t reading = 0; reading < BENCH_READINGS; reading++)
+	{
+		accum_a.reset();
+		accum_b.reset();
+		a(reading, &accum_a);
+		b(reading, &accum_b);
+		if (strcmp(accum_a.c_str(), accum_b.c_str()) != 0) { differences++; }
+	}
+	return differences;
+}
+
+/*
+ * putLittleEndian
+ * Writes the count low bytes of value to buffer, least significant first (as sd.cpp)
+ */
+static char * putLittleEndian(char * buffer, uint32_t value, uint8_t count)
+{
+	while (count--)
+	{
+		*buffer++ = (char)(value & 0xFF);
+		value >>= 8;
+	}
+	return buffer;
+}
+
+/*
+ * buildBinaryRecords
+ * Fills s_records with the values buildRecord writes, with BENCH_FIELDS, one second apart
+ */
+static void buildBinaryRecords()
+{
+	for (uint16_t reading = 0; reading < BENCH_READINGS; reading++)
+	{
+		char * p = s_records[reading];
+		*p++ = (char)BINARY_RECORD_MARKER;
+		p = putLittleEndian(p, BINARY_PACK_TIMESTAMP(15, 11, 3, 0, reading / 60, reading % 60), 4);
+		p = putLittleEndian(p, reading * 3UL, 3);
+		p = putLittleEndian(p, reading, 3);
+		p = putLittleEndian(p, reading % 8, 1);
+		p = putLittleEndian(p, reading, 2); // Irradiance
+		p = putLittleEndian(p, reading, 2); // Battery
+	}
+}
+
+/*
+ * timeDelta
+ * Returns the mean time in ns to delta encode one record (as writeRecord in sd.cpp),
+ * and the mean bytes per record in bytes
+ */
+static double timeDelta(unsigned long passes, double * bytes)
+{
+	char delta[BINARY_MAX_DELTA_SIZE];
+	uint8_t size = BINARY_RecordSize(BENCH_FIELDS);
+	unsigned long total = 0;
+
+	uint64_t start = nanoseconds();
+	for (unsigned long pass = 0; pass < passes; pass++)
+	{
+		DELTA_Reset();
+		for (uint16_t reading = 0; reading < BENCH_READINGS; reading++)
+		{
+			uint8_t length = DELTA_Encode(s_records[reading], BENCH_FIELDS, 1, delta);
+			DELTA_SetReference(s_records[reading], size);
+			total += length ? length : size;
+		}
+	}
+	uint64_t elapsed = nanoseconds() - start;
+
+	s_sink += total;
+	*bytes = (double)total / ((double)passes * BENCH_READINGS);
+	return (double)elapsed / ((double)passes * BENCH_READINGS);
+}
+
+/*
+ * recordBytes
+ * Returns the mean length of the CSV records from buildRecord
+ */
+static double recordBytes()
+{
+	char text[BENCH_TEXT_LENGTH * 2];
+	FixedLengthAccumulator accum(text, sizeof(text));
+	unsigned long total = 0;
+
+	for (uint16_t reading = 0; reading < BENCH_READINGS; reading++)
+	{
+		accum.reset();
+		buildRecord(reading, &accum);
+		total += accum.length();
+	}
+	return (double)total / BENCH_READINGS;
+}
+
+/*
+ * countRecordDifferences
+ * Returns the number of readings for which the old and new accumulators build different records
+ */
+static unsigned countRecordDifferences()
+{
+	char text_old[BENCH_TEXT_LENGTH * 2];
+	char text_new[BENCH_TEXT_LENGTH * 2];
+	OldAccumulator accum_old(text_old, sizeof(text_old));
+	FixedLengthAccumulator accum_new(text_new, sizeof(text_new));
+	unsigned differences = 0;
+
+	for (uint16_t reading = 0; reading < BENCH_READINGS; reading++)
+	{
+		accum_old.reset();
+		accum_new.reset();
+		buildRecord(reading, &accum_old);
+		buildRecord(reading, &accum_new);
+		if (strcmp(accum_old.c_str(), accum_new.c_str()) != 0) { differences++; }
+	}
+	return differences;
+}
+
+/*
+ * Public Functions
+ */
+
+int main(int argc, char * argv[])
+{
+	unsigned long passes = (argc > 1) ? strtoul(argv[1], NULL, 10) : 2000;
+	if (passes == 0) { passes = 1; }
+
+	printf("Value to text (%lu x %u readings)   dtostrf ns   fixed ns   speed-up   differences\n", passes, BENCH_READINGS);
+	for (size_t i = 0; i < (sizeof(s_benchmarks) / sizeof(s_benchmarks[0])); i++)
+	{
+		const struct benchmark * bench = &s_benchmarks[i];
+		double old_ns = timeConversion(bench->old_code, passes);
+		double new_ns = timeConversion(bench->new_code, passes);
+
+		printf("  %-32s %10.1f %10.1f %9.1fx %13u\n", bench->name, old_ns, new_ns, old_ns / new_ns,
+			countDifferences(bench->old_code, bench->new_code));
+	}
+
+	double old_ns = timeRecord<OldAccumulator>(passes);
+	double new_ns = timeRecord<FixedLengthAccumulator>(passes);
+	printf("Record build (%lu x %u records)    old ns     new ns   speed-up   differences\n", passes, BENCH_READINGS);
+	printf("  %-32s %10.1f %10.1f %9.1fx %13u\n", "Default CSV fields", old_ns, new_ns, old_ns / new_ns,
+		countRecordDifferences());
+
+	double delta_bytes;
+	buildBinaryRecords();
+	double delta_ns = timeDelta(passes, &delta_bytes);
+	printf("Record encode (%lu x %u records)        ns      bytes\n", passes, BENCH_READINGS);
+	printf("  %-32s %10.1f %10.1f\n", "CSV text", new_ns, recordBytes());
+	printf("  %-32s %10.1f %10.1f\n", "Delta", delta_ns, delta_bytes);
+
+	return 0;
+}
@@ -0,0 +1,507 @@
+/*
+ * wlconvert.cpp
+ *
+ * Converts binary data files written by the Wind Data logger (SD_BINARY_FORMAT = 1,
+ * with or without SD_DELTA_ENCODING) into the same CSV format that the logger writes
+ * when SD_BINARY_FORMAT = 0.
+ *
+ * Usage: wlconvert [-s] D151103.bin > D151103.csv
+ *
+ * With -s, the size of the binary data per record is compared to the CSV output.
+ *
+ * Raw stream files (SD_RAW_STREAM, .raw) are converted to one CSV line per second,
+ * with the pulses counted by each anemometer in that second and the wind vane direction.
+ *
+ * If the file has BINARY_FIELD_CHECKED set, the CRC of every record is checked and
+ * records that fail are skipped. The exit code is then 2 if any records failed.
+ *
+ * James Fowkes
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+
+#include <vector>
+
+#include "binary_record.h"
+#include "fixed_point.h"
+
+/*
+ * Defines and typedefs
+ */
+
+struct decoder
+{
+	struct binary_file_header header;
+	bool delta_encoded;
+	const uint8_t * data;
+	size_t size;
+};
+
+struct statistics
+{
+	unsigned long records;
+	unsigned long keyframes;
+	unsigned long binary_bytes;
+	unsigned long csv_bytes;
+	unsigned long bad_records;
+	unsigned long sequence_gaps;
+};
+
+/*
+ * Private Variables
+ */
+
+static const char * s_directions[] = {"N", "NE", "E", "SE", "S", "SW", "W", "NW"};
+
+/*
+ * Private Functions
+ */
+
+static void put_little_endian(uint8_t * data, uint32_t value, uint8_t count)
+{
+	while (count--)
+	{
+		*data++ = (uint8_t)(value & 0xFF);
+		value >>= 8;
+	}
+}
+
+static const uint8_t * get_varint(const uint8_t * data, uint32_t * value)
+{
+	uint8_t shift = 0;
+	*value = 0;
+	do
+	{
+		*value |= (uint32_t)(*data & 0x7F) << shift;
+		shift += 7;
+	} while (*data++ & 0x80);
+	return data;
+}
+
+static bool read_file(const char * filename, std::vector<uint8_t> &buffer)
+{
+	FILE * file = fopen(filename, "rb");
+	if (!file) { return false; }
+
+	uint8_t chunk[4096];
+	size_t count;
+	while ((count = fread(chunk, 1, sizeof(chunk), file)) > 0)
+	{
+		buffer.insert(buffer.end(), chunk, chunk + count);
+	}
+
+	bool success = !ferror(file);
+	fclose(file);
+	return success;
+}
+
+static int print_headers(uint8_t fields, FILE * out)
+{
+	int count = 0;
+
+	// These must match the s_pstr_headers string in sd.cpp
+	count += fprintf(out, "Ref, Date, Time, ");
+	if (fields & BINARY_FIELD_WINDSPEED) { count += fprintf(out, "Wind 1, Wind 2, "); }
+	if (fields & BINARY_FIELD_WIND_DIRECTION) { count += fprintf(out, "Direction, "); }
+	if (fields & BINARY_FIELD_TEMPERATURE) { count += fprintf(out, "Temp C, "); }
+	if (fields & BINARY_FIELD_IRRADIANCE) { count += fprintf(out, "Irradiance Wm-2, "); }
+	if (fields & BINARY_FIELD_EXTERNAL_VOLTS) { count += fprintf(out, "Ext V, "); }
+	if (fields & BINARY_FIELD_EXTERNAL_AMPS) { count += fprintf(out, "Current, "); }
+	count += fprintf(out, "Batt V");
+	if (fields & BINARY_FIELD_BACKFILLED) { count += fprintf(out, ", Backfilled"); }
+	if (fields & BINARY_FIELD_CHECKED) { count += fprintf(out, ", Seq, CRC"); }
+	count += fprintf(out, "\r\n");
+	return count;
+}
+
+/*
+ * The conversions below are the same calculations as the logger uses in each module's
+ * Write...ToBuffer function. Each returns the value in hundredths (see fixed_point.h).
+ */
+
+static int32_t thermistor_to_celsius(const struct binary_file_header * header, uint16_t reading)
+{
+	float balance = header->thermistor_balance;
+	float R = (1024.0f * balance / float(reading)) - balance;
+	float T = 1.0f / (1.0f / header->thermistor_t0 + (1.0f / header->thermistor_b) * logf(R / header->thermistor_r0));
+	return FIXED_FromFloat(T - 273.15f, 2);
+}
+
+static int32_t reading_to_irradiance(uint16_t reading)
+{
+	return ((int32_t)reading * 200) + 4670;
+}
+
+static int32_t reading_to_external_voltage(const struct binary_file_header * header, uint16_t reading)
+{
+	uint32_t r1 = header->r1;
+	uint32_t r2 = header->r2;
+	return r2 ? (int32_t)FIXED_MulDiv(reading * (r1 + r2), 110, 341 * r2) : 0;
+}
+
+static int32_t reading_to_external_current(const struct binary_file_header * header, uint16_t reading)
+{
+	int32_t current = ((int32_t)reading - (20L * header->current_offset)) * (int16_t)header->current_gain;
+	int32_t centiamps = (int32_t)FIXED_MulDiv((current < 0) ? -current : current, 11, 682);
+	return (current < 0) ? -centiamps : centiamps;
+}
+
+static int32_t reading_to_battery_voltage(uint16_t reading)
+{
+	return (int32_t)FIXED_MulDiv(reading, 1881, 1024);
+}
+
+/*
+ * print_fixed
+ * Adds ",value" to the line, with the value printed as the logger prints it
+ */
+static int print_fixed(char * line, size_t size, int32_t value)
+{
+	char number[FIXED_MAX_LENGTH + 1];
+	FIXED_Format(number, value, 2);
+	return snprintf(line, size, ",%s", number);
+}
+
+static int print_record(const struct decoder * decoder, const uint8_t * record, FILE * out)
+{
+	const struct binary_file_header * header = &decoder->header;
+	const uint8_t * p = record + 1;
+	char line[256];
+	int count = 0;
+
+	uint32_t timestamp = BINARY_GetLittleEndian(p, 4);
+	p += 4;
+
+	count += snprintf(&line[count], sizeof(line) - count, "%c%c,%02u-%02u-%04u,%02u:%02u:%02u",
+		header->device_id[0], header->device_id[1],
+		(unsigned)BINARY_TIMESTAMP_DAY(timestamp),
+		(unsigned)BINARY_TIMESTAMP_MONTH(timestamp),
+		(unsigned)BINARY_TIMESTAMP_YEAR(timestamp) + 2000,
+		(unsigned)BINARY_TIMESTAMP_HOUR(timestamp),
+		(unsigned)BINARY_TIMESTAMP_MINUTE(timestamp),
+		(unsigned)BINARY_TIMESTAMP_SECOND(timestamp));
+
+	if (header->fields & BINARY_FIELD_WINDSPEED)
+	{
+		count += snprintf(&line[count], sizeof(line) - count, ",%lu", (unsigned long)BINARY_GetLittleEndian(p, 3));
+		count += snprintf(&line[count], sizeof(line) - count, ",%lu", (unsigned long)BINARY_GetLittleEndian(p + 3, 3));
+		p += 6;
+	}
+
+	if (header->fields & BINARY_FIELD_WIND_DIRECTION)
+	{
+		count += snprintf(&line[count], sizeof(line) - count, ",%s", (*p < 8) ? s_directions[*p] : "");
+		p += 1;
+	}
+
+	if (header->fields & BINARY_FIELD_TEMPERATURE)
+	{
+		count += print_fixed(&line[count], sizeof(line) - count, thermistor_to_celsius(header, BINARY_GetLittleEndian(p, 2)));
+		p += 2;
+	}
+
+	if (header->fields & BINARY_FIELD_IRRADIANCE)
+	{
+		count += print_fixed(&line[count], sizeof(line) - count, reading_to_irradiance(BINARY_GetLittleEndian(p, 2)));
+		p += 2;
+	}
+
+	if (header->fields & BINARY_FIELD_EXTERNAL_VOLTS)
+	{
+		count += print_fixed(&line[count], sizeof(line) - count, reading_to_external_voltage(header, BINARY_GetLittleEndian(p, 2)));
+		p += 2;
+	}
+
+	if (header->fields & BINARY_FIELD_EXTERNAL_AMPS)
+	{
+		count += print_fixed(&line[count], sizeof(line) - count, reading_to_external_current(header, BINARY_GetLittleEndian(p, 2)));
+		p += 2;
+	}
+
+	count += print_fixed(&line[count], sizeof(line) - count, reading_to_battery_voltage(BINARY_GetLittleEndian(p, 2)));
+
+	if (header->fields & BINARY_FIELD_BACKFILLED)
+	{
+		count += snprintf(&line[count], sizeof(line) - count, ",%c", (record[0] == BINARY_BACKFILL_MARKER) ? '1' : '0');
+	}
+
+	if (header->fields & BINARY_FIELD_CHECKED)
+	{
+		// The CRC column is the CRC of the rest of the line (up to and including the comma before it)
+		count += snprintf(&line[count], sizeof(line) - count, ",%lu,", (unsigned long)BINARY_GetLittleEndian(p + 2, 4));
+		count += snprintf(&line[count], sizeof(line) - count, "%04X", BINARY_Crc16(BINARY_CRC16_INIT, (const uint8_t *)line, count));
+	}
+
+	count += snprintf(&line[count], sizeof(line) - count, "\r\n");
+	fputs(line, out);
+	return count;
+}
+
+/*
+ * apply_delta
+ * Updates the full record in current with the delta record at data
+ */
+static void apply_delta(const struct decoder * decoder, const uint8_t * data, uint8_t * current)
+{
+	uint8_t widths[BINARY_MAX_VALUES];
+	uint8_t count = BINARY_GetValueWidths(decoder->header.fields, widths);
+	uint32_t value;
+
+	uint32_t timestamp = BINARY_GetLittleEndian(&current[1], 4);
+	data = get_varint(data, &value);
+	int32_t seconds = BINARY_TimestampSeconds(timestamp) + BINARY_UnZigZag(value - 1) + (int32_t)decoder->header.sample_time;
+
+	timestamp = BINARY_PACK_TIMESTAMP(
+		BINARY_TIMESTAMP_YEAR(timestamp), BINARY_TIMESTAMP_MONTH(timestamp), BINARY_TIMESTAMP_DAY(timestamp),
+		seconds / 3600, (seconds / 60) % 60, seconds % 60);
+	put_little_endian(&current[1], timestamp, 4);
+
+	uint8_t offset = 1 + 4;
+	for (uint8_t i = 0; i < count; i++)
+	{
+		data = get_varint(data, &value);
+		int32_t reference = (int32_t)BINARY_GetLittleEndian(&current[offset], widths[i]);
+		put_little_endian(&current[offset], (uint32_t)(reference + BINARY_UnZigZag(value)), widths[i]);
+		offset += widths[i];
+	}
+}
+
+/*
+ * record_is_valid
+ * Returns true if the record (keyframe or delta) at data is intact.
+ * Records without BINARY_FIELD_CHECKED are always taken as valid.
+ */
+static bool record_is_valid(const struct decoder * decoder, const uint8_t * data, size_t length)
+{
+	if ((decoder->header.fields & BINARY_FIELD_CHECKED) == 0) { return true; }
+	return BINARY_Crc16(BINARY_CRC16_INIT, data, length - 2) == BINARY_GetLittleEndian(&data[length - 2], 2);
+}
+
+/*
+ * check_sequence
+ * Counts a gap in the sequence numbers of the live (not backfilled) records
+ */
+static void check_sequence(const struct decoder * decoder, const uint8_t * record, struct statistics * stats,
+	bool * have_sequence, uint32_t * last_sequence)
+{
+	if (((decoder->header.fields & BINARY_FIELD_CHECKED) == 0) || (record[0] == BINARY_BACKFILL_MARKER)) { return; }
+
+	uint32_t sequence = BINARY_GetLittleEndian(&record[decoder->header.record_size - 6], 4);
+	if (*have_sequence && (sequence != *last_sequence + 1))
+	{
+		stats->sequence_gaps++;
+	}
+	*have_sequence = true;
+	*last_sequence = sequence;
+}
+
+/*
+ * decode
+ * Prints every record in the file and fills in the statistics
+ */
+static void decode(const struct decoder * decoder, FILE * out, struct statistics * stats)
+{
+	size_t record_size = decoder->header.record_size;
+	size_t position = sizeof(struct binary_file_header);
+	uint8_t current[BINARY_MAX_RECORD_SIZE];
+	bool have_reference = false;
+	bool have_sequence = false;
+	uint32_t last_sequence = 0;
+
+	stats->csv_bytes += print_headers(decoder->header.fields, out);
+
+	while (position < decoder->size)
+	{
+		size_t sector_offset = position % BINARY_SECTOR_SIZE;
+		size_t available = decoder->size - position;
+		const uint8_t * data = &decoder->data[position];
+		size_t length = 0;
+
+		// Every sector starts with a keyframe
+		if (sector_offset == 0) { have_reference = false; }
+
+		if (BINARY_IsRecordMarker(data[0]) && ((sector_offset + record_size) <= BINARY_SECTOR_SIZE) && (record_size <= available))
+		{
+			length = record_size;
+			if (!record_is_valid(decoder, data, length))
+			{
+				// Deltas after a bad keyframe can't be decoded
+				stats->bad_records++;
+				have_reference = false;
+				position += length;
+				continue;
+			}
+			memcpy(current, data, record_size);
+			have_reference = true;
+			stats->keyframes++;
+		}
+		else if (decoder->delta_encoded && have_reference && (data[0] != 0x00) && (data[0] != 0xFF))
+		{
+			uint16_t space = BINARY_SECTOR_SIZE - sector_offset;
+			length = BINARY_DeltaRecordLength(data, (available < space) ? available : space, decoder->header.fields);
+			if (length && !record_is_valid(decoder, data, length))
+			{
+				// The rest of the sector depends on this record
+				stats->bad_records++;
+				have_reference = false;
+				position += BINARY_SECTOR_SIZE - sector_offset;
+				continue;
+			}
+			if (length)
+			{
+				// Delta records are never backfilled, and follow on from the previous sequence number
+				apply_delta(decoder, data, current);
+				current[0] = BINARY_RECORD_MARKER;
+				if (decoder->header.fields & BINARY_FIELD_CHECKED)
+				{
+					uint8_t * sequence = &current[record_size - 6];
+					put_little_endian(sequence, BINARY_GetLittleEndian(sequence, 4) + 1, 4);
+				}
+			}
+		}
+
+		if (length == 0)
+		{
+			// Either padding up to the end of the sector or the end of the data
+			if (sector_offset == 0) { break; }
+			position += BINARY_SECTOR_SIZE - sector_offset;
+			continue;
+		}
+
+		check_sequence(decoder, current, stats, &have_sequence, &last_sequence);
+		stats->csv_bytes += print_record(decoder, current, out);
+		stats->records++;
+		position += length;
+		stats->binary_bytes = position - sizeof(struct binary_file_header);
+	}
+}
+
+static void decode_raw(const struct decoder * decoder, FILE * out, struct statistics * stats)
+{
+	const struct binary_file_header * header = &decoder->header;
+	size_t position = sizeof(struct binary_file_header);
+	struct binary_raw_chunk chunk;
+
+	stats->csv_bytes += fprintf(out, "Ref, Date, Time, Wind 1, Wind 2, Direction\r\n");
+
+	// Any torn chunk at the end of the file is ignored
+	while ((position + sizeof(chunk)) <= decoder->size)
+	{
+		memcpy(&chunk, &decoder->data[position], sizeof(chunk));
+		position += sizeof(chunk);
+
+		if ((chunk.count == 0) || (chunk.count > BINARY_RAW_SECONDS))
+		{
+			stats->bad_records++;
+			continue;
+		}
+
+		// Chunks never straddle a file change, so never cross midnight
+		int32_t seconds = BINARY_TimestampSeconds(chunk.timestamp);
+		for (uint8_t i = 0; i < chunk.count; i++, seconds++)
+		{
+			const struct binary_raw_second * second = &chunk.seconds[i];
+			stats->csv_bytes += fprintf(out, "%c%c,%02u-%02u-%04u,%02u:%02u:%02u,%u,%u,%s\r\n",
+				header->device_id[0], header->device_id[1],
+				(unsigned)BINARY_TIMESTAMP_DAY(chunk.timestamp),
+				(unsigned)BINARY_TIMESTAMP_MONTH(chunk.timestamp),
+				(unsigned)BINARY_TIMESTAMP_YEAR(chunk.timestamp) + 2000,
+				(unsigned)((seconds / 3600) % 24), (unsigned)((seconds / 60) % 60), (unsigned)(seconds % 60),
+				(unsigned)second->pulses[0], (unsigned)second->pulses[1],
+				(second->direction < 8) ? s_directions[second->direction] : "");
+			stats->records++;
+		}
+		stats->binary_bytes = position - sizeof(struct binary_file_header);
+	}
+}
+
+static void print_statistics(const struct statistics * stats)
+{
+	fprintf(stderr, "Records: %lu", stats->records);
+	if (stats->keyframes) { fprintf(stderr, " (%lu keyframes)", stats->keyframes); }
+	fprintf(stderr, "\n");
+	fprintf(stderr, "Bad records: %lu\n", stats->bad_records);
+	fprintf(stderr, "Sequence gaps: %lu\n", stats->sequence_gaps);
+	if (stats->records == 0) { return; }
+
+	fprintf(stderr, "Binary bytes per record: %.2f\n", (double)stats->binary_bytes / stats->records);
+	fprintf(stderr, "CSV bytes per record: %.2f\n", (double)stats->csv_bytes / stats->records);
+	fprintf(stderr, "Compression: %.1f%% of CSV\n", 100.0 * stats->binary_bytes / stats->csv_bytes);
+}
+
+int main(int argc, char * argv[])
+{
+	bool show_statistics = (argc == 3) && (strcmp(argv[1], "-s") == 0);
+
+	if ((argc != 2) && !show_statistics)
+	{
+		fprintf(stderr, "Usage: %s [-s] <file.bin|file.raw>\n", argv[0]);
+		fprintf(stderr, "Converts a Wind Data logger binary file to CSV on stdout\n");
+		fprintf(stderr, "  -s  Print the binary and CSV bytes per record (and any errors) to stderr\n");
+		return 1;
+	}
+
+	const char * filename = argv[argc - 1];
+
+	std::vector<uint8_t> buffer;
+	if (!read_file(filename, buffer))
+	{
+		fprintf(stderr, "Could not read %s\n", filename);
+		return 1;
+	}
+
+	struct decoder decoder;
+	if (buffer.size() < sizeof(decoder.header))
+	{
+		fprintf(stderr, "%s is too short for a binary header\n", filename);
+		return 1;
+	}
+
+	memcpy(&decoder.header, &buffer[0], sizeof(decoder.header));
+	decoder.data = &buffer[0];
+	decoder.size = buffer.size();
+
+	bool raw_stream = (memcmp(decoder.header.magic, BINARY_RAW_MAGIC, sizeof(decoder.header.magic)) == 0);
+	decoder.delta_encoded = (memcmp(decoder.header.magic, BINARY_DELTA_MAGIC, sizeof(decoder.header.magic)) == 0);
+	if (!raw_stream && !decoder.delta_encoded && (memcmp(decoder.header.magic, BINARY_HEADER_MAGIC, sizeof(decoder.header.magic)) != 0))
+	{
+		fprintf(stderr, "%s is not a Wind Data logger binary file\n", filename);
+		return 1;
+	}
+
+	if (decoder.header.version != BINARY_FORMAT_VERSION)
+	{
+		fprintf(stderr, "%s has unsupported format version %u\n", filename, (unsigned)decoder.header.version);
+		return 1;
+	}
+
+	uint8_t record_size = raw_stream ? sizeof(struct binary_raw_chunk) : BINARY_RecordSize(decoder.header.fields);
+	if (decoder.header.record_size != record_size)
+	{
+		fprintf(stderr, "%s has a record size that does not match its fields\n", filename);
+		return 1;
+	}
+
+	struct statistics stats = {0, 0, 0, 0, 0, 0};
+	if (raw_stream)
+	{
+		decode_raw(&decoder, stdout, &stats);
+	}
+	else
+	{
+		decode(&decoder, stdout, &stats);
+	}
+
+	if (show_statistics) { print_statistics(&stats); }
+
+	if (stats.bad_records)
+	{
+		fprintf(stderr, "%s: %lu records failed their checks\n", filename, stats.bad_records);
+		return 2;
+	}
+
+	return 0;
+}
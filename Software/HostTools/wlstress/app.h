@@ -0,0 +1,33 @@
+/*
+ * app.h (wlstress)
+ *
+ * The switches wind.cpp is built with for the stress test: every option that adds to the
+ * pulse banks or the per-second totals is on. This uses the same include guard as the
+ * logger's app.h, so that file is skipped when wind.cpp includes it.
+ */
+
+#ifndef _APP_H_
+#define _APP_H_
+
+#define READ_WINDSPEED 1
+#define READ_WIND_STATISTICS 1
+#define READ_WIND_PERIODS 1
+#define WIND_DEBOUNCE 1
+#define READ_WIND_DIRECTION 1
+#define WIND_VECTOR_DIRECTION 0
+#define WIND_WEIGHTED_DIRECTION 0
+#define READ_TEMPERATURE 0
+#define READ_IRRADIANCE 0
+#define READ_EXTERNAL_VOLTS 0
+#define READ_EXTERNAL_AMPS 0
+#define SD_BINARY_FORMAT 0
+#define SD_DELTA_ENCODING 0
+#define SD_STORE_AND_FORWARD 0
+#define SD_RECORD_CHECKS 0
+#define SD_RAW_STREAM 1
+#define SD_DAILY_SUMMARY 0
+
+void APP_SecondTick();
+bool APP_InDebugMode();
+
+#endif
@@ -0,0 +1,79 @@
+/*
+ * Arduino.h (host)
+ *
+ * Just enough of the Arduino core for wlstress to build wind.cpp and utility.cpp on a PC.
+ * The AVR registers are plain variables, and the pulse "interrupts" are called from a signal handler.
+ */
+
+#ifndef _HOST_ARDUINO_H_
+#define _HOST_ARDUINO_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <stdlib.h>
+
+#ifndef F_CPU
+#define F_CPU 16000000UL
+#endif
+
+typedef uint8_t byte;
+
+#define PROGMEM
+#define HIGH 1
+#define LOW 0
+#define INPUT 0
+#define OUTPUT 1
+#define CHANGE 1
+#define FALLING 2
+#define RISING 3
+#define A0 14
+
+inline uint8_t pgm_read_byte(const void * p) { return *(const uint8_t *)p; }
+inline uint16_t pgm_read_word(const void * p) { return *(const uint16_t *)p; }
+inline void * memcpy_P(void * d, const void * s, size_t n) { return memcpy(d, s, n); }
+inline size_t strlen_P(const char * s) { return strlen(s); }
+
+void pinMode(uint8_t pin, uint8_t mode);
+void digitalWrite(uint8_t pin, uint8_t value);
+unsigned long micros();
+void noInterrupts();
+void interrupts();
+
+#define ISR(vector) extern "C" void vector(void)
+#define _BV(b) (1 << (b))
+
+class __FlashStringHelper;
+
+class Print
+{
+public:
+  size_t print(const char * s);
+  size_t print(const __FlashStringHelper * s);
+  size_t print(char c);
+  size_t print(unsigned long n, int base = 10);
+  size_t println(const char * s);
+  size_t println(const __FlashStringHelper * s);
+  size_t println(int n, int base = 10);
+  size_t println(unsigned int n, int base = 10);
+  size_t println(long n, int base = 10);
+  size_t println(unsigned long n, int base = 10);
+  size_t println();
+};
+
+class HardwareSerial : public Print
+{
+public:
+  void flush() {}
+};
+extern HardwareSerial Serial;
+
+// Timer1 (READ_WIND_PERIODS)
+extern volatile uint8_t TCCR1A, TCCR1B, TIMSK1, TIFR1;
+extern volatile uint16_t TCNT1;
+#define CS10 0
+#define CS12 2
+#define TOIE1 0
+#define TOV1 0
+
+#endif
@@ -0,0 +1,13 @@
+/*
+ * EnableInterrupt.h (host)
+ *
+ * wlstress calls the pulse interrupt handlers itself, so attaching them does nothing.
+ */
+
+#ifndef _HOST_ENABLE_INTERRUPT_H_
+#define _HOST_ENABLE_INTERRUPT_H_
+
+inline void enableInterrupt(int pin, void (*handler)(void), int mode) { (void)pin; (void)handler; (void)mode; }
+inline void disableInterrupt(int pin) { (void)pin; }
+
+#endif
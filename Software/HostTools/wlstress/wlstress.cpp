@@ -0,0 +1,198 @@
+/*
+ * wlstress.cpp
+ *
+ * Stress test for the anemometer pulse counting in wind.cpp, run on a PC.
+ *
+ * Usage: wlstress [seconds]
+ *
+ * wind.cpp is built with the switches in the app.h next to this file. A POSIX timer signal
+ * every 20us stands in for the pulse interrupts (anemometer 1 on every signal, anemometer 2
+ * on every other one) and for the RTC tick (every 97th signal). Meanwhile the main program
+ * does what the logger's main loop does, as fast as it can: it reads the live and per-second
+ * counts, updates the statistics and ends a period, so the signal keeps landing part way
+ * through the bank swap and the counter reads.
+ *
+ * At the end the signal is blocked and every pulse must be accounted for: the counted and
+ * rejected pulses over all the periods must add up to the pulses sent, and the per-second
+ * counts must add up to the counted pulses.
+ *
+ * The exit code is 1 if any pulse was lost and 0 otherwise.
+ *
+ * James Fowkes
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <signal.h>
+#include <time.h>
+
+#include "app.h"
+#include "wind.cpp"
+
+/*
+ * Defines and typedefs
+ */
+
+#define STRESS_SIGNAL_NS 20000 // Time between "interrupts"
+#define STRESS_TICK_SIGNALS 97 // "Interrupts" per RTC tick
+#define STRESS_US_PER_SIGNAL 250 // micros() per "interrupt", against a 1 ms lockout
+#define STRESS_LOCKOUT_MS 1
+
+/*
+ * Host stand-ins for the logger
+ */
+
+HardwareSerial Serial;
+volatile uint8_t TCCR1A, TCCR1B, TIMSK1, TIFR1;
+volatile uint16_t TCNT1;
+
+size_t Print::print(const char * s) { (void)s; return 0; }
+size_t Print::print(const __FlashStringHelper * s) { (void)s; return 0; }
+size_t Print::print(char c) { (void)c; return 0; }
+size_t Print::print(unsigned long n, int base) { (void)n; (void)base; return 0; }
+size_t Print::println(const char * s) { (void)s; return 0; }
+size_t Print::println(const __FlashStringHelper * s) { (void)s; return 0; }
+size_t Print::println(int n, int base) { (void)n; (void)base; return 0; }
+size_t Print::println(unsigned int n, int base) { (void)n; (void)base; return 0; }
+size_t Print::println(long n, int base) { (void)n; (void)base; return 0; }
+size_t Print::println(unsigned long n, int base) { (void)n; (void)base; return 0; }
+size_t Print::println() { return 0; }
+
+void pinMode(uint8_t pin, uint8_t mode) { (void)pin; (void)mode; }
+void digitalWrite(uint8_t pin, uint8_t value) { (void)pin; (void)value; }
+void EEPROM_SetWindwavePosition(bool set) { (void)set; }
+bool APP_InDebugMode() { return false; }
+
+// The pulse counting must not depend on these, so they do nothing
+void noInterrupts() {}
+void interrupts() {}
+
+static volatile unsigned long s_micros = 0;
+unsigned long micros() { return s_micros; }
+
+/*
+ * Private Variables
+ */
+
+static volatile unsigned long s_sent[2] = {0, 0};
+static volatile unsigned long s_signals = 0;
+
+/*
+ * Private Functions
+ */
+
+/*
+ * onSignal
+ * The "interrupts": a pulse on each anemometer, and now and then the RTC tick
+ */
+static void onSignal(int signal)
+{
+	(void)signal;
+
+	s_signals++;
+	s_micros += STRESS_US_PER_SIGNAL;
+	if (++TCNT1 == 0) { TIMER1_OVF_vect(); }
+
+	if ((s_signals % STRESS_TICK_SIGNALS) == 0) { WIND_SecondTick(); }
+
+	pulse1();
+	s_sent[0]++;
+	if (s_signals & 1)
+	{
+		pulse2();
+		s_sent[1]++;
+	}
+}
+
+static bool startSignals()
+{
+	struct sigaction action = {};
+	action.sa_handler = onSignal;
+	if (sigaction(SIGUSR1, &action, NULL) != 0) { return false; }
+
+	struct sigevent event = {};
+	event.sigev_notify = SIGEV_SIGNAL;
+	event.sigev_signo = SIGUSR1;
+	timer_t timer;
+	if (timer_create(CLOCK_MONOTONIC, &event, &timer) != 0) { return false; }
+
+	struct itimerspec interval = {};
+	interval.it_interval.tv_nsec = STRESS_SIGNAL_NS;
+	interval.it_value.tv_nsec = STRESS_SIGNAL_NS;
+	return timer_settime(timer, 0, &interval, NULL) == 0;
+}
+
+static void stopSignals()
+{
+	sigset_t signals;
+	sigemptyset(&signals);
+	sigaddset(&signals, SIGUSR1);
+	sigprocmask(SIG_BLOCK, &signals, NULL);
+}
+
+/*
+ * Public Functions
+ */
+
+int main(int argc, char * argv[])
+{
+	unsigned long counted[2] = {0, 0};
+	unsigned long rejected[2] = {0, 0};
+	unsigned long seconds[2] = {0, 0};
+	unsigned long periods = 0;
+	bool torn = false;
+
+	time_t run = (argc > 1) ? atol(argv[1]) : 10;
+
+	WIND_SetupWindPulseInterrupts();
+	WIND_SetDebounce(STRESS_LOCKOUT_MS);
+
+	if (!startSignals())
+	{
+		perror("wlstress");
+		return 1;
+	}
+
+	time_t end = time(NULL) + run;
+	do
+	{
+		// A torn read of the live count shows up as a negative or huge value
+		if (WIND_GetLivePulseCount(0) < 0) { torn = true; }
+
+		uint8_t counts[2];
+		WIND_GetSecondPulseCounts(counts);
+		WIND_UpdateStatistics();
+		WIND_StoreWindPulseCounts();
+		periods++;
+
+		for (uint8_t i = 0; i < 2; i++)
+		{
+			seconds[i] += counts[i];
+			counted[i] += WIND_GetStoredPulseCount(i);
+			rejected[i] += WIND_GetRejectedCount(i);
+		}
+	} while (time(NULL) < end);
+
+	stopSignals();
+
+	// Pick up the pulses since the last period
+	uint8_t counts[2];
+	WIND_GetSecondPulseCounts(counts);
+	WIND_StoreWindPulseCounts();
+
+	bool lost = torn;
+	for (uint8_t i = 0; i < 2; i++)
+	{
+		seconds[i] += counts[i];
+		counted[i] += WIND_GetStoredPulseCount(i);
+		rejected[i] += WIND_GetRejectedCount(i);
+
+		printf("Anemometer %u: %lu sent, %lu counted, %lu rejected, %lu in the per-second counts\n",
+			i + 1, s_sent[i], counted[i], rejected[i], seconds[i]);
+
+		if (((counted[i] + rejected[i]) != s_sent[i]) || (seconds[i] != counted[i])) { lost = true; }
+	}
+
+	printf("%lu periods, %lu interrupts: %s\n", periods, s_signals, lost ? "PULSES LOST" : "no pulses lost");
+	return lost ? 1 : 0;
+}
@@ -0,0 +1,176 @@
+/*
+ * wlvalidate.cpp
+ *
+ * Checks CSV data files written by the Wind Data logger with SD_RECORD_CHECKS = 1
+ * (or converted from binary files by wlconvert) in a single pass.
+ *
+ * Usage: wlvalidate D151103.csv [D151104.csv ...]
+ *
+ * Every record line must end with ",<sequence>,<CRC>\r\n", where the CRC is
+ * BINARY_Crc16 of the rest of the line in four hex digits. Lines that fail are
+ * reported as bad. Sequence numbers should go up by one per record: a jump forward is
+ * reported as a gap (records are missing or the logger was reset) and a jump back
+ * as out of order (usually records that were backfilled after the SD card was replaced).
+ *
+ * The exit code is 2 if any line is bad, 1 if a file could not be read and 0 otherwise.
+ *
+ * James Fowkes
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "binary_record.h"
+
+/*
+ * Defines and typedefs
+ */
+
+#define MAX_LINE_LENGTH 256
+
+struct results
+{
+	unsigned long records;
+	unsigned long bad_lines;
+	unsigned long gaps;
+	unsigned long missing;
+	unsigned long out_of_order;
+};
+
+/*
+ * Private Functions
+ */
+
+/*
+ * read_line
+ * Reads the next line (including its "\r\n") into line and returns its length,
+ * or 0 at the end of the file. Lines longer than the buffer are truncated.
+ */
+static size_t read_line(FILE * file, char * line)
+{
+	size_t length = 0;
+	int c;
+
+	while ((c = getc(file)) != EOF)
+	{
+		if (length < MAX_LINE_LENGTH) { line[length++] = (char)c; }
+		if (c == '\n') { break; }
+	}
+	return length;
+}
+
+/*
+ * check_line
+ * Returns true if the line ends with a valid sequence number and CRC, and fills in the sequence number
+ */
+static bool check_line(const char * line, size_t length, uint32_t * sequence)
+{
+	// ",<sequence>,XXXX\r\n"
+	if ((length < 9) || (line[length - 1] != '\n') || (line[length - 2] != '\r') || (line[length - 7] != ','))
+	{
+		return false;
+	}
+
+	char crc[5];
+	snprintf(crc, sizeof(crc), "%04X", BINARY_Crc16(BINARY_CRC16_INIT, (const uint8_t *)line, length - 6));
+	if (memcmp(crc, &line[length - 6], 4) != 0) { return false; }
+
+	size_t start = length - 7;
+	while ((start > 0) && (line[start - 1] != ',')) { start--; }
+	if ((start == 0) || (start == length - 7)) { return false; }
+
+	char * end;
+	*sequence = strtoul(&line[start], &end, 10);
+	return end == &line[length - 7];
+}
+
+static bool validate(const char * filename, struct results * results)
+{
+	FILE * file = fopen(filename, "rb");
+	if (!file)
+	{
+		fprintf(stderr, "Could not read %s\n", filename);
+		return false;
+	}
+
+	char line[MAX_LINE_LENGTH];
+	size_t length;
+	unsigned long line_number = 0;
+	bool have_sequence = false;
+	uint32_t expected = 0;
+
+	while ((length = read_line(file, line)) > 0)
+	{
+		uint32_t sequence;
+		line_number++;
+
+		if ((line_number == 1) && (strncmp(line, "Ref,", 4) == 0))
+		{
+			if ((length < 12) || (memcmp(&line[length - 12], ", Seq, CRC", 10) != 0))
+			{
+				printf("%s: no Seq and CRC columns (was SD_RECORD_CHECKS set?)\n", filename);
+			}
+			continue;
+		}
+
+		if (!check_line(line, length, &sequence))
+		{
+			printf("%s:%lu: bad record\n", filename, line_number);
+			results->bad_lines++;
+			continue;
+		}
+
+		results->records++;
+		if (have_sequence && (sequence != expected))
+		{
+			if (sequence > expected)
+			{
+				printf("%s:%lu: sequence gap (%lu missing)\n", filename, line_number, (unsigned long)(sequence - expected));
+				results->gaps++;
+				results->missing += sequence - expected;
+			}
+			else
+			{
+				printf("%s:%lu: sequence out of order\n", filename, line_number);
+				results->out_of_order++;
+				// Backfilled records don't affect the live sequence
+				continue;
+			}
+		}
+		have_sequence = true;
+		expected = sequence + 1;
+	}
+
+	fclose(file);
+	return true;
+}
+
+int main(int argc, char * argv[])
+{
+	if (argc < 2)
+	{
+		fprintf(stderr, "Usage: %s <file.csv> [<file.csv> ...]\n", argv[0]);
+		fprintf(stderr, "Checks the CRC and sequence number of every record in Wind Data logger CSV files\n");
+		return 1;
+	}
+
+	struct results total = {0, 0, 0, 0, 0};
+	bool read_all = true;
+
+	for (int i = 1; i < argc; i++)
+	{
+		struct results results = {0, 0, 0, 0, 0};
+		read_all &= validate(argv[i], &results);
+
+		printf("%s: %lu records, %lu bad, %lu gaps (%lu missing), %lu out of order\n", argv[i],
+			results.records, results.bad_lines, results.gaps, results.missing, results.out_of_order);
+
+		total.records += results.records;
+		total.bad_lines += results.bad_lines;
+	}
+
+	if (total.bad_lines) { return 2; }
+	return read_all ? 0 : 1;
+}